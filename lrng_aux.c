@@ -19,60 +19,97 @@ struct batched_entropy {
 		u32 entropy_u32[LRNG_DRNG_BLOCKSIZE / sizeof(u32)];
 	};
 	unsigned int position;
-	spinlock_t batch_lock;
+	unsigned long generation;
+	atomic_t in_use;
 };
 
+/*
+ * Generation counter of the batches: a batch whose generation does not match
+ * this counter is stale and is refilled on next use. Invalidation of all
+ * batches therefore only requires the increment of this counter instead of
+ * locking and updating all per-CPU batches.
+ */
+static atomic_long_t lrng_batch_generation = ATOMIC_LONG_INIT(0);
+
 /*
  * Get a random word for internal kernel use only. The quality of the random
  * number is as good as /dev/urandom, but there is no backtrack protection,
  * with the goal of being quite fast and not depleting entropy.
+ *
+ * The batches are accessed lock-less with only preemption disabled: each CPU
+ * operates on its own batch and the in_use flag detects the reentrant use of
+ * the batch when an interrupt handler on the same CPU requests random numbers
+ * while the interrupted task operates on the batch. The reentrant caller
+ * leaves the batch untouched and is served directly from the DRNG. This
+ * eliminates the interrupt-disable/enable pair per word of output of the
+ * former per-batch spinlock.
  */
 static DEFINE_PER_CPU(struct batched_entropy, batched_entropy_u64) = {
-	.batch_lock	= __SPIN_LOCK_UNLOCKED(batched_entropy_u64.lock),
+	.position	= UINT_MAX
 };
 
 u64 get_random_u64(void)
 {
 	u64 ret;
-	unsigned long flags;
+	unsigned long generation;
 	struct batched_entropy *batch;
 
 	lrng_debug_report_seedlevel("get_random_u64");
 
-	batch = raw_cpu_ptr(&batched_entropy_u64);
-	spin_lock_irqsave(&batch->batch_lock, flags);
-	if (batch->position % ARRAY_SIZE(batch->entropy_u64) == 0) {
+	batch = get_cpu_ptr(&batched_entropy_u64);
+	if (unlikely(atomic_cmpxchg(&batch->in_use, 0, 1) != 0)) {
+		put_cpu_ptr(&batched_entropy_u64);
+		lrng_drng_get_atomic((u8 *)&ret, sizeof(ret));
+		return ret;
+	}
+
+	generation = (unsigned long)atomic_long_read(&lrng_batch_generation);
+	if (batch->position >= ARRAY_SIZE(batch->entropy_u64) ||
+	    batch->generation != generation) {
 		lrng_drng_get_atomic((u8 *)batch->entropy_u64,
 				      LRNG_DRNG_BLOCKSIZE);
 		batch->position = 0;
+		batch->generation = generation;
 	}
 	ret = batch->entropy_u64[batch->position++];
-	spin_unlock_irqrestore(&batch->batch_lock, flags);
+
+	atomic_set(&batch->in_use, 0);
+	put_cpu_ptr(&batched_entropy_u64);
 	return ret;
 }
 EXPORT_SYMBOL(get_random_u64);
 
 static DEFINE_PER_CPU(struct batched_entropy, batched_entropy_u32) = {
-	.batch_lock	= __SPIN_LOCK_UNLOCKED(batched_entropy_u32.lock),
+	.position	= UINT_MAX
 };
 
 u32 get_random_u32(void)
 {
 	u32 ret;
-	unsigned long flags;
+	unsigned long generation;
 	struct batched_entropy *batch;
 
 	lrng_debug_report_seedlevel("get_random_u32");
 
-	batch = raw_cpu_ptr(&batched_entropy_u32);
-	spin_lock_irqsave(&batch->batch_lock, flags);
-	if (batch->position % ARRAY_SIZE(batch->entropy_u32) == 0) {
+	batch = get_cpu_ptr(&batched_entropy_u32);
+	if (unlikely(atomic_cmpxchg(&batch->in_use, 0, 1) != 0)) {
+		put_cpu_ptr(&batched_entropy_u32);
+		lrng_drng_get_atomic((u8 *)&ret, sizeof(ret));
+		return ret;
+	}
+
+	generation = (unsigned long)atomic_long_read(&lrng_batch_generation);
+	if (batch->position >= ARRAY_SIZE(batch->entropy_u32) ||
+	    batch->generation != generation) {
 		lrng_drng_get_atomic((u8 *)batch->entropy_u32,
 				      LRNG_DRNG_BLOCKSIZE);
 		batch->position = 0;
+		batch->generation = generation;
 	}
 	ret = batch->entropy_u32[batch->position++];
-	spin_unlock_irqrestore(&batch->batch_lock, flags);
+
+	atomic_set(&batch->in_use, 0);
+	put_cpu_ptr(&batched_entropy_u32);
 	return ret;
 }
 EXPORT_SYMBOL(get_random_u32);
@@ -80,27 +117,14 @@ EXPORT_SYMBOL(get_random_u32);
 /*
  * It's important to invalidate all potential batched entropy that might
  * be stored before the crng is initialized, which we can do lazily by
- * simply resetting the counter to zero so that it's re-extracted on the
- * next usage.
+ * bumping the generation counter so that every batch is re-extracted on its
+ * next usage. This neither requires a lock nor the modification of remote
+ * per-CPU data.
  */
 void invalidate_batched_entropy(void)
 {
-	int cpu;
-	unsigned long flags;
-
-	for_each_possible_cpu(cpu) {
-		struct batched_entropy *batched_entropy;
-
-		batched_entropy = per_cpu_ptr(&batched_entropy_u32, cpu);
-		spin_lock_irqsave(&batched_entropy->batch_lock, flags);
-		batched_entropy->position = 0;
-		spin_unlock(&batched_entropy->batch_lock);
-
-		batched_entropy = per_cpu_ptr(&batched_entropy_u64, cpu);
-		spin_lock(&batched_entropy->batch_lock);
-		batched_entropy->position = 0;
-		spin_unlock_irqrestore(&batched_entropy->batch_lock, flags);
-	}
+	atomic_long_inc(&lrng_batch_generation);
+	lrng_cc20_invalidate_insecure();
 }
 
 /*
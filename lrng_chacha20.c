@@ -97,6 +97,46 @@ static int lrng_cc20_drng_seed_helper(void *drng, const u8 *inbuf, u32 inbuflen)
 	return 0;
 }
 
+/*
+ * Maximum number of bytes generated with one keystream invocation. The SIMD
+ * implementations of ChaCha20 process 4 or 8 blocks per iteration, thus the
+ * value is sized such that the widest implementation is utilized.
+ */
+#define LRNG_CC20_MULTIBLOCK_SIZE	(8 * CHACHA_BLOCK_SIZE)
+
+#ifdef CONFIG_LRNG_CHACHA20_SIMD
+
+/*
+ * Generate full blocks of keystream with the architecture-optimized ChaCha20
+ * library code. As chacha_crypt() XORs the keystream into the source data,
+ * the output buffer is zeroized beforehand to obtain the raw keystream. The
+ * library transparently falls back to the generic implementation when the
+ * SIMD unit is unusable in the calling context.
+ */
+static void lrng_cc20_keystream(struct chacha20_block *chacha20,
+				u8 *outbuf, u32 todo)
+{
+	BUILD_BUG_ON(sizeof(struct chacha20_block) !=
+		     CHACHA_STATE_WORDS * sizeof(u32));
+
+	memset(outbuf, 0, todo);
+	chacha_crypt(&chacha20->constants[0], outbuf, outbuf, todo, 20);
+}
+
+#else /* CONFIG_LRNG_CHACHA20_SIMD */
+
+static void lrng_cc20_keystream(struct chacha20_block *chacha20,
+				u8 *outbuf, u32 todo)
+{
+	while (todo) {
+		chacha20_block(&chacha20->constants[0], outbuf);
+		outbuf += CHACHA_BLOCK_SIZE;
+		todo -= CHACHA_BLOCK_SIZE;
+	}
+}
+
+#endif /* CONFIG_LRNG_CHACHA20_SIMD */
+
 /*
  * Chacha20 DRNG generation of random numbers: the stream output of ChaCha20
  * is the random number. After the completion of the generation of the
@@ -119,9 +159,13 @@ static int lrng_cc20_drng_generate_helper(void *drng, u8 *outbuf, u32 outbuflen)
 	int zeroize_buf = 0;
 
 	while (outbuflen >= CHACHA_BLOCK_SIZE) {
-		chacha20_block(&chacha20->constants[0], outbuf);
-		outbuf += CHACHA_BLOCK_SIZE;
-		outbuflen -= CHACHA_BLOCK_SIZE;
+		u32 todo = min_t(u32, outbuflen, LRNG_CC20_MULTIBLOCK_SIZE);
+
+		/* Only process full blocks with the keystream operation. */
+		todo &= ~(CHACHA_BLOCK_SIZE - 1);
+		lrng_cc20_keystream(chacha20, outbuf, todo);
+		outbuf += todo;
+		outbuflen -= todo;
 	}
 
 	if (outbuflen) {
@@ -185,6 +229,130 @@ static void lrng_cc20_drng_dealloc(void *drng)
 	kfree_sensitive(chacha20_state);
 }
 
+/*********************** Insecure per-CPU fast path **************************/
+
+#ifdef CONFIG_LRNG_INSECURE_FAST_PATH
+
+/*
+ * Callers of getrandom(2) with the GRND_INSECURE flag explicitly waived the
+ * guarantee of fully seeded random numbers. Such requests are served from
+ * per-CPU ChaCha20 sub-instances which are periodically rekeyed from the
+ * parent DRNG. This removes the parent DRNG lock from the request path such
+ * that insecure random numbers scale with the number of CPUs.
+ *
+ * The instances follow the access pattern of the batches in lrng_aux.c: the
+ * in_use flag detects the reentrant use of an instance and diverts the
+ * reentrant caller to the parent DRNG, and a global generation counter
+ * lazily invalidates all instances when the seed status of the LRNG changes.
+ */
+struct lrng_cc20_insecure {
+	struct chacha20_state state;
+	u32 requests;
+	unsigned long last_seeded;	/* jiffies of last rekey */
+	unsigned long generation;
+	atomic_t in_use;
+	bool seeded;
+};
+
+static DEFINE_PER_CPU(struct lrng_cc20_insecure, lrng_cc20_insecure);
+
+static atomic_long_t lrng_cc20_insecure_generation = ATOMIC_LONG_INIT(0);
+
+/*
+ * Invalidate all per-CPU sub-instances - each instance is rekeyed from the
+ * parent DRNG on its next use.
+ */
+void lrng_cc20_invalidate_insecure(void)
+{
+	atomic_long_inc(&lrng_cc20_insecure_generation);
+}
+
+/*
+ * lrng_cc20_get_insecure() - Get random data from the per-CPU ChaCha20
+ * sub-instance of the current CPU
+ *
+ * The sub-instance is rekeyed from the parent DRNG following the reseed
+ * criteria of the parent DRNG: after LRNG_DRNG_RESEED_THRESH generate
+ * requests, after lrng_drng_reseed_max_time seconds, or when the seed status
+ * of the LRNG changed since the last rekey.
+ *
+ * This function may sleep and thus can only be used in process context.
+ *
+ * @outbuf: buffer to store the random data in
+ * @outbuflen: length of outbuf
+ * Return: number of bytes generated or negative error code
+ */
+int lrng_cc20_get_insecure(u8 *outbuf, u32 outbuflen)
+{
+	struct lrng_cc20_insecure *insecure;
+	unsigned long generation;
+	int ret;
+
+	if (!outbuflen)
+		return 0;
+
+	outbuflen = min_t(u32, outbuflen, LRNG_DRNG_MAX_REQSIZE);
+
+	insecure = get_cpu_ptr(&lrng_cc20_insecure);
+	if (unlikely(atomic_cmpxchg_acquire(&insecure->in_use, 0, 1) != 0)) {
+		put_cpu_ptr(&lrng_cc20_insecure);
+		return lrng_drng_get_sleep(outbuf, outbuflen);
+	}
+
+	/*
+	 * The in_use flag provides the exclusive ownership of the instance.
+	 * Therefore preemption can be re-enabled which allows the rekey
+	 * operation to sleep while pulling the seed from the parent DRNG. A
+	 * task migrated away from the CPU keeps operating on the instance it
+	 * acquired while new requests on that CPU divert to the parent DRNG.
+	 */
+	put_cpu_ptr(&lrng_cc20_insecure);
+
+	generation =
+	       (unsigned long)atomic_long_read(&lrng_cc20_insecure_generation);
+	if (!insecure->seeded || insecure->generation != generation ||
+	    !insecure->requests ||
+	    time_after(jiffies, insecure->last_seeded +
+			lrng_drng_reseed_max_time * HZ)) {
+		u8 seedbuf[CHACHA_KEY_SIZE] __aligned(LRNG_KCAPI_ALIGN);
+
+		ret = lrng_drng_get_sleep(seedbuf, sizeof(seedbuf));
+		if (ret != sizeof(seedbuf)) {
+			atomic_set_release(&insecure->in_use, 0);
+			/* The parent cannot deliver - serve from it directly */
+			return (ret < 0) ? ret :
+			       lrng_drng_get_sleep(outbuf, outbuflen);
+		}
+
+		if (!insecure->seeded)
+			lrng_cc20_init_state(&insecure->state);
+		lrng_cc20_drng_seed_helper(&insecure->state, seedbuf,
+					   sizeof(seedbuf));
+		memzero_explicit(seedbuf, sizeof(seedbuf));
+
+		insecure->seeded = true;
+		insecure->generation = generation;
+		insecure->requests = LRNG_DRNG_RESEED_THRESH;
+		insecure->last_seeded = jiffies;
+		pr_debug("insecure ChaCha20 instance of CPU %d rekeyed\n",
+			 raw_smp_processor_id());
+	}
+	insecure->requests--;
+
+	ret = lrng_cc20_drng_generate_helper(&insecure->state, outbuf,
+					     outbuflen);
+
+	/*
+	 * The owner may have migrated to another CPU - order the state
+	 * updates before the release of the instance so that the next
+	 * acquirer on the home CPU observes them.
+	 */
+	atomic_set_release(&insecure->in_use, 0);
+	return ret;
+}
+
+#endif /* CONFIG_LRNG_INSECURE_FAST_PATH */
+
 /******************************* Hash Operation *******************************/
 
 #ifdef CONFIG_CRYPTO_LIB_SHA256
@@ -0,0 +1,318 @@
+// SPDX-License-Identifier: GPL-2.0 OR BSD-2-Clause
+/*
+ * Backend for the LRNG providing a dedicated SP800-90A CTR DRBG with
+ * AES-256 core.
+ *
+ * In contrast to the generic DRBG backend which routes every request
+ * through the kernel crypto API DRBG implementation, this backend
+ * implements the CTR DRBG state handling directly and generates the
+ * output with the ctr(aes) skcipher. The kernel crypto API resolves
+ * ctr(aes) to the highest-priority implementation which is the
+ * arch-optimized pipelined implementation (e.g. AES-NI on x86) when its
+ * driver is enabled. All scratch memory is preallocated with the DRBG
+ * instance such that the generate path performs no memory allocation.
+ *
+ * Copyright (C) 2021, Stephan Mueller <smueller@chronox.de>
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <crypto/hash.h>
+#include <crypto/skcipher.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/lrng.h>
+
+#include "lrng_kcapi_hash.h"
+
+/* AES-256 parameters as defined in SP800-90A table 3 */
+#define LRNG_DRBG_CTR_KEYLEN	32
+#define LRNG_DRBG_CTR_BLOCKLEN	16
+#define LRNG_DRBG_CTR_SEEDLEN	(LRNG_DRBG_CTR_KEYLEN + LRNG_DRBG_CTR_BLOCKLEN)
+
+/*
+ * The scratch buffer covers the maximum request size the LRNG submits in
+ * one generate call (LRNG_DRNG_MAX_REQSIZE) such that the common case is
+ * handled with one skcipher invocation keeping the AES pipeline filled.
+ */
+#define LRNG_DRBG_CTR_SCRATCH	(1 << 12)
+
+struct lrng_drbg_ctr {
+	struct crypto_sync_skcipher *ctr_aes;
+	void *lrng_hash;			/* Seed conditioner */
+	u8 key[LRNG_DRBG_CTR_KEYLEN];		/* Key K */
+	u8 v[LRNG_DRBG_CTR_BLOCKLEN];		/* Counter V */
+
+	/*
+	 * Preallocated generate buffer: the output buffer handed in by the
+	 * LRNG may be stack memory which cannot be mapped into a
+	 * scatterlist. The keystream is therefore generated into this
+	 * buffer and copied out.
+	 */
+	u8 scratch[];
+};
+
+/* Increment the big-endian counter V by one */
+static void lrng_drbg_ctr_inc(u8 *ctr)
+{
+	int i = LRNG_DRBG_CTR_BLOCKLEN;
+
+	while (i--) {
+		if (++ctr[i])
+			break;
+	}
+}
+
+/* Decrement the big-endian counter V by one */
+static void lrng_drbg_ctr_dec(u8 *ctr)
+{
+	int i = LRNG_DRBG_CTR_BLOCKLEN;
+
+	while (i--) {
+		if (ctr[i]--)
+			break;
+	}
+}
+
+static int lrng_drbg_ctr_crypt(struct lrng_drbg_ctr *drbg, u8 *iv, u8 *buf,
+			       u32 buflen)
+{
+	SYNC_SKCIPHER_REQUEST_ON_STACK(req, drbg->ctr_aes);
+	struct scatterlist sg;
+	int ret;
+
+	sg_init_one(&sg, buf, buflen);
+	skcipher_request_set_sync_tfm(req, drbg->ctr_aes);
+	skcipher_request_set_callback(req, 0, NULL, NULL);
+	skcipher_request_set_crypt(req, &sg, &sg, buflen, iv);
+	ret = crypto_skcipher_encrypt(req);
+	skcipher_request_zero(req);
+
+	return ret;
+}
+
+/*
+ * CTR DRBG update function as defined in SP800-90A section 10.2.1.2: the
+ * provided data is XORed into seedlen bits of keystream and the result
+ * forms the new key and counter. The keystream blocks of V + 1 up to
+ * V + 3 encrypted with a single CTR operation are identical to the
+ * per-block encryptions mandated by the standard.
+ */
+static int lrng_drbg_ctr_update(struct lrng_drbg_ctr *drbg, const u8 *provided)
+{
+	u8 iv[LRNG_DRBG_CTR_BLOCKLEN];
+	u8 *temp = drbg->scratch;
+	int ret;
+	u32 i;
+
+	memcpy(iv, drbg->v, LRNG_DRBG_CTR_BLOCKLEN);
+	lrng_drbg_ctr_inc(iv);
+
+	memset(temp, 0, LRNG_DRBG_CTR_SEEDLEN);
+	ret = lrng_drbg_ctr_crypt(drbg, iv, temp, LRNG_DRBG_CTR_SEEDLEN);
+	if (ret)
+		goto out;
+
+	if (provided) {
+		for (i = 0; i < LRNG_DRBG_CTR_SEEDLEN; i++)
+			temp[i] ^= provided[i];
+	}
+
+	memcpy(drbg->key, temp, LRNG_DRBG_CTR_KEYLEN);
+	memcpy(drbg->v, temp + LRNG_DRBG_CTR_KEYLEN, LRNG_DRBG_CTR_BLOCKLEN);
+	ret = crypto_sync_skcipher_setkey(drbg->ctr_aes, drbg->key,
+					  LRNG_DRBG_CTR_KEYLEN);
+
+out:
+	memzero_explicit(temp, LRNG_DRBG_CTR_SEEDLEN);
+	memzero_explicit(iv, sizeof(iv));
+	return ret;
+}
+
+/*
+ * The DRBG operates without derivation function which requires a
+ * full-entropy input of exactly seedlen bits. The seed buffer delivered
+ * by the LRNG is therefore condensed with SHA-512 as vetted conditioning
+ * component and truncated to seedlen bits. The LRNG oversamples the
+ * entropy sources relative to the DRNG security strength such that the
+ * digest contains the requested amount of entropy.
+ */
+static int lrng_drbg_ctr_drng_seed_helper(void *drng, const u8 *inbuf,
+					  u32 inbuflen)
+{
+	SHASH_DESC_ON_STACK(shash, NULL);
+	struct lrng_drbg_ctr *drbg = (struct lrng_drbg_ctr *)drng;
+	u8 digest[64] __aligned(8);
+	int ret;
+
+	BUILD_BUG_ON(sizeof(digest) < LRNG_DRBG_CTR_SEEDLEN);
+
+	ret = lrng_kcapi_hash_init(shash, drbg->lrng_hash) ?:
+	      lrng_kcapi_hash_update(shash, inbuf, inbuflen) ?:
+	      lrng_kcapi_hash_final(shash, digest);
+	lrng_kcapi_hash_zero(shash);
+	if (ret)
+		return ret;
+
+	ret = lrng_drbg_ctr_update(drbg, digest);
+	memzero_explicit(digest, sizeof(digest));
+
+	return ret;
+}
+
+/* CTR DRBG generate function as defined in SP800-90A section 10.2.1.5.1 */
+static int lrng_drbg_ctr_drng_generate_helper(void *drng, u8 *outbuf,
+					      u32 outbuflen)
+{
+	struct lrng_drbg_ctr *drbg = (struct lrng_drbg_ctr *)drng;
+	u8 iv[LRNG_DRBG_CTR_BLOCKLEN];
+	u32 generated = 0, todo = 0;
+	int ret;
+
+	memcpy(iv, drbg->v, LRNG_DRBG_CTR_BLOCKLEN);
+	lrng_drbg_ctr_inc(iv);
+
+	while (generated < outbuflen) {
+		todo = min_t(u32, outbuflen - generated,
+			     LRNG_DRBG_CTR_SCRATCH);
+
+		memset(drbg->scratch, 0, todo);
+		ret = lrng_drbg_ctr_crypt(drbg, iv, drbg->scratch, todo);
+		if (ret)
+			goto err;
+
+		memcpy(outbuf + generated, drbg->scratch, todo);
+		generated += todo;
+	}
+
+	/*
+	 * The skcipher leaves the IV at the counter following the last full
+	 * keystream block, but it does not advance the counter past a
+	 * trailing partial block. Normalize the IV to the counter following
+	 * the last used block before stepping back to the last used counter
+	 * value which the standard defines as the new V. Stepping back
+	 * without the normalization would make the update below recompute
+	 * the partially emitted keystream block as the leading bytes of the
+	 * new key and reuse a counter value.
+	 */
+	if (outbuflen % LRNG_DRBG_CTR_BLOCKLEN)
+		lrng_drbg_ctr_inc(iv);
+	lrng_drbg_ctr_dec(iv);
+	memcpy(drbg->v, iv, LRNG_DRBG_CTR_BLOCKLEN);
+
+	/* Update of key and counter for backtracking resistance */
+	ret = lrng_drbg_ctr_update(drbg, NULL);
+
+err:
+	memzero_explicit(drbg->scratch, LRNG_DRBG_CTR_SCRATCH);
+	memzero_explicit(iv, sizeof(iv));
+	return ret ? ret : (int)generated;
+}
+
+static void *lrng_drbg_ctr_drng_alloc(u32 sec_strength)
+{
+	struct lrng_drbg_ctr *drbg;
+	struct crypto_sync_skcipher *ctr_aes;
+	void *lrng_hash;
+	int ret;
+
+	if (sec_strength > LRNG_DRBG_CTR_KEYLEN) {
+		pr_err("Security strength of CTR DRBG AES-256 (%u bits) lower than requested by LRNG (%u bits)\n",
+		       LRNG_DRBG_CTR_KEYLEN * 8, sec_strength * 8);
+		return ERR_PTR(-EINVAL);
+	}
+
+	drbg = kzalloc(sizeof(*drbg) + LRNG_DRBG_CTR_SCRATCH, GFP_KERNEL);
+	if (!drbg)
+		return ERR_PTR(-ENOMEM);
+
+	ctr_aes = crypto_alloc_sync_skcipher("ctr(aes)", 0, 0);
+	if (IS_ERR(ctr_aes)) {
+		pr_err("Cipher ctr(aes) cannot be allocated\n");
+		ret = PTR_ERR(ctr_aes);
+		goto err;
+	}
+	drbg->ctr_aes = ctr_aes;
+
+	/* Instantiate: key and counter are zero before the initial seed */
+	ret = crypto_sync_skcipher_setkey(drbg->ctr_aes, drbg->key,
+					  LRNG_DRBG_CTR_KEYLEN);
+	if (ret)
+		goto err_cipher;
+
+	lrng_hash = lrng_kcapi_hash_alloc("sha512");
+	if (IS_ERR(lrng_hash)) {
+		ret = PTR_ERR(lrng_hash);
+		goto err_cipher;
+	}
+	drbg->lrng_hash = lrng_hash;
+
+	pr_info("CTR DRBG with %s core allocated\n",
+		crypto_tfm_alg_driver_name(
+			crypto_skcipher_tfm(&ctr_aes->base)));
+
+	return drbg;
+
+err_cipher:
+	crypto_free_sync_skcipher(drbg->ctr_aes);
+err:
+	kfree(drbg);
+	return ERR_PTR(ret);
+}
+
+static void lrng_drbg_ctr_drng_dealloc(void *drng)
+{
+	struct lrng_drbg_ctr *drbg = (struct lrng_drbg_ctr *)drng;
+
+	crypto_free_sync_skcipher(drbg->ctr_aes);
+	lrng_kcapi_hash_dealloc(drbg->lrng_hash);
+	kfree_sensitive(drbg);
+	pr_info("CTR DRBG deallocated\n");
+}
+
+static void *lrng_drbg_ctr_hash_alloc(void)
+{
+	return lrng_kcapi_hash_alloc("sha512");
+}
+
+static const char *lrng_drbg_ctr_name(void)
+{
+	return "CTR DRBG AES-256";
+}
+
+static const char *lrng_drbg_ctr_hash_name(void)
+{
+	return "sha512";
+}
+
+static const struct lrng_crypto_cb lrng_drbg_ctr_crypto_cb = {
+	.lrng_drng_name			= lrng_drbg_ctr_name,
+	.lrng_hash_name			= lrng_drbg_ctr_hash_name,
+	.lrng_drng_alloc		= lrng_drbg_ctr_drng_alloc,
+	.lrng_drng_dealloc		= lrng_drbg_ctr_drng_dealloc,
+	.lrng_drng_seed_helper		= lrng_drbg_ctr_drng_seed_helper,
+	.lrng_drng_generate_helper	= lrng_drbg_ctr_drng_generate_helper,
+	.lrng_hash_alloc		= lrng_drbg_ctr_hash_alloc,
+	.lrng_hash_dealloc		= lrng_kcapi_hash_dealloc,
+	.lrng_hash_digestsize		= lrng_kcapi_hash_digestsize,
+	.lrng_hash_init			= lrng_kcapi_hash_init,
+	.lrng_hash_update		= lrng_kcapi_hash_update,
+	.lrng_hash_final		= lrng_kcapi_hash_final,
+	.lrng_hash_desc_zero		= lrng_kcapi_hash_zero,
+};
+
+static int __init lrng_drbg_ctr_init(void)
+{
+	return lrng_set_drng_cb(&lrng_drbg_ctr_crypto_cb);
+}
+
+static void __exit lrng_drbg_ctr_exit(void)
+{
+	lrng_set_drng_cb(NULL);
+}
+
+late_initcall(lrng_drbg_ctr_init);
+module_exit(lrng_drbg_ctr_exit);
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_AUTHOR("Stephan Mueller <smueller@chronox.de>");
+MODULE_DESCRIPTION("Linux Random Number Generator - dedicated SP800-90A CTR DRBG backend");
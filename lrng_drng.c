@@ -24,13 +24,22 @@ static atomic_t lrng_avail = ATOMIC_INIT(0);
 
 DEFINE_MUTEX(lrng_crypto_cb_update);
 
+/*
+ * Hash reference of the standby ChaCha20 DRNG - it is never released and
+ * serves as initial reference for all DRNG instances and entropy pools.
+ */
+struct lrng_drng_hash lrng_cc20_drng_hash = {
+	.crypto_cb	= &lrng_cc20_crypto_cb,
+	.hash		= NULL,
+};
+
 /* DRNG for /dev/urandom, getrandom(2), get_random_bytes */
 static struct lrng_drng lrng_drng_init = {
 	.drng		= &chacha20,
+	.hash_state	= RCU_INITIALIZER(&lrng_cc20_drng_hash),
 	.crypto_cb	= &lrng_cc20_crypto_cb,
 	.lock		= __MUTEX_INITIALIZER(lrng_drng_init.lock),
-	.spin_lock	= __SPIN_LOCK_UNLOCKED(lrng_drng_init.spin_lock),
-	.hash_lock	= __RW_LOCK_UNLOCKED(lrng_drng_init.hash_lock)
+	.spin_lock	= __SPIN_LOCK_UNLOCKED(lrng_drng_init.spin_lock)
 };
 
 /*
@@ -44,9 +53,9 @@ static struct lrng_drng lrng_drng_init = {
  */
 static struct lrng_drng lrng_drng_atomic = {
 	.drng		= &chacha20,
+	.hash_state	= RCU_INITIALIZER(&lrng_cc20_drng_hash),
 	.crypto_cb	= &lrng_cc20_crypto_cb,
-	.spin_lock	= __SPIN_LOCK_UNLOCKED(lrng_drng_atomic.spin_lock),
-	.hash_lock	= __RW_LOCK_UNLOCKED(lrng_drng_atomic.hash_lock)
+	.spin_lock	= __SPIN_LOCK_UNLOCKED(lrng_drng_atomic.spin_lock)
 };
 
 static u32 max_wo_reseed = LRNG_DRNG_MAX_WITHOUT_RESEED;
@@ -195,6 +204,91 @@ static void lrng_drng_inject(struct lrng_drng *drng,
 	lrng_drng_unlock(drng, &flags);
 }
 
+#ifdef CONFIG_LRNG_SEED_AHEAD
+
+/* Schedule the pre-computation when this many generate requests are left. */
+#define LRNG_SEED_AHEAD_THRESH	(LRNG_DRNG_RESEED_THRESH >> 4)
+
+static struct entropy_buf lrng_seed_ahead_buf __aligned(LRNG_KCAPI_ALIGN);
+static bool lrng_seed_ahead_valid;
+static DEFINE_MUTEX(lrng_seed_ahead_lock);
+
+/*
+ * Pre-compute the seed buffer for the next reseed operation. The buffer is
+ * filled for the request size of a fully seeded DRNG as DRNGs that are not
+ * yet fully seeded use the inline seeding path with its oversampled request.
+ */
+static void _lrng_seed_ahead_work(struct work_struct *work)
+{
+	mutex_lock(&lrng_seed_ahead_lock);
+	if (!lrng_seed_ahead_valid) {
+		lrng_fill_seed_buffer(&lrng_seed_ahead_buf,
+				      lrng_get_seed_entropy_osr(true));
+		WRITE_ONCE(lrng_seed_ahead_valid, true);
+	}
+	mutex_unlock(&lrng_seed_ahead_lock);
+}
+
+static DECLARE_WORK(lrng_seed_ahead_work, _lrng_seed_ahead_work);
+
+/*
+ * Trigger the pre-computation of the seed buffer shortly before the reseed
+ * threshold is reached so that the buffer is ready when the threshold hits.
+ */
+static void lrng_seed_ahead_schedule(struct lrng_drng *drng)
+{
+	if (drng == &lrng_drng_atomic ||
+	    atomic_read(&drng->requests) > LRNG_SEED_AHEAD_THRESH ||
+	    READ_ONCE(lrng_seed_ahead_valid) ||
+	    !drng->fully_seeded)
+		return;
+
+	schedule_work(&lrng_seed_ahead_work);
+}
+
+/*
+ * Inject the pre-computed seed buffer into the DRNG. The operation only
+ * performs the seed helper call of the DRNG implementation - the expensive
+ * entropy collection already happened in the worker. If no pre-computed
+ * buffer is present, the caller falls back to the inline seeding operation.
+ */
+static bool lrng_seed_ahead_inject(struct lrng_drng *drng)
+{
+	bool injected = false;
+
+	if (!drng->fully_seeded || !READ_ONCE(lrng_seed_ahead_valid))
+		return false;
+
+	if (!mutex_trylock(&lrng_seed_ahead_lock))
+		return false;
+
+	if (lrng_seed_ahead_valid) {
+		lrng_init_ops(&lrng_seed_ahead_buf);
+		lrng_drng_inject(drng, (u8 *)&lrng_seed_ahead_buf,
+				 sizeof(lrng_seed_ahead_buf),
+				 lrng_fully_seeded(drng->fully_seeded,
+						   &lrng_seed_ahead_buf));
+		memzero_explicit(&lrng_seed_ahead_buf,
+				 sizeof(lrng_seed_ahead_buf));
+		WRITE_ONCE(lrng_seed_ahead_valid, false);
+		injected = true;
+	}
+	mutex_unlock(&lrng_seed_ahead_lock);
+
+	return injected;
+}
+
+#else /* CONFIG_LRNG_SEED_AHEAD */
+
+static void lrng_seed_ahead_schedule(struct lrng_drng *drng) { }
+
+static bool lrng_seed_ahead_inject(struct lrng_drng *drng)
+{
+	return false;
+}
+
+#endif /* CONFIG_LRNG_SEED_AHEAD */
+
 /*
  * Perform the seeding of the DRNG with data from noise source
  */
@@ -202,6 +296,9 @@ static inline void _lrng_drng_seed(struct lrng_drng *drng)
 {
 	struct entropy_buf seedbuf __aligned(LRNG_KCAPI_ALIGN);
 
+	if (lrng_seed_ahead_inject(drng))
+		return;
+
 	lrng_fill_seed_buffer(&seedbuf,
 			      lrng_get_seed_entropy_osr(drng->fully_seeded));
 	lrng_init_ops(&seedbuf);
@@ -241,21 +338,153 @@ static void lrng_drng_seed(struct lrng_drng *drng)
 		}
 		memzero_explicit(&seedbuf, sizeof(seedbuf));
 	}
+
+	/* Tell shared random page consumers that their data became stale. */
+	lrng_shared_pages_reseed();
 }
 
+/*
+ * Upper bound of the per-instance reseed stagger: the instance index scales
+ * with the core count for CPU-granular DRNG instances and an unbounded
+ * stagger would push last_seeded so far into the future that all time-based
+ * reseed checks are disabled for hours on larger systems.
+ */
+#define LRNG_DRNG_SEED_STAGGER_MAX	4
+
+/* Set when an instance of the current seeding round became fully seeded. */
+static bool lrng_drng_seed_round_seeded;
+
 static inline void _lrng_drng_seed_work(struct lrng_drng *drng, u32 node)
 {
-	pr_debug("reseed triggered by interrupt noise source for DRNG on NUMA node %d\n",
+	pr_debug("reseed triggered by interrupt noise source for DRNG instance %d\n",
 		 node);
 	lrng_drng_seed(drng);
 	if (drng->fully_seeded) {
 		/* Prevent reseed storm */
-		drng->last_seeded += node * 100 * HZ;
+		drng->last_seeded += min_t(u32, node,
+					   LRNG_DRNG_SEED_STAGGER_MAX) *
+				     100 * HZ;
+		/* Concurrent set-only stores of the same value are benign. */
+		WRITE_ONCE(lrng_drng_seed_round_seeded, true);
+	}
+}
+
+/*
+ * Complete a seeding round: relax the reseed interval once per round. Doing
+ * it per seeded instance would inflate the interval proportionally to the
+ * instance count in a single round.
+ */
+static void lrng_drng_seed_round_done(void)
+{
+	if (READ_ONCE(lrng_drng_seed_round_seeded)) {
+		lrng_drng_seed_round_seeded = false;
 		/* Prevent draining of pool on idle systems */
 		lrng_drng_reseed_max_time += 100;
 	}
 }
 
+/*
+ * Per-instance seed work items bound to instance-local CPUs: all DRNG
+ * instances requiring a seed are processed concurrently and each instance
+ * pulls its seed buffer - including the per-CPU pool hashing - with
+ * node-local memory traffic instead of one CPU serially walking all remote
+ * nodes. The per-CPU entropy pools are individually locked and the entropy
+ * accounting is atomic, hence concurrent seed buffer fills are safe.
+ */
+struct lrng_seed_instance_work {
+	struct work_struct work;
+	struct lrng_drng *drng;
+	u32 node;
+};
+
+static struct lrng_seed_instance_work *lrng_seed_instance_works;
+static atomic_t lrng_seed_instance_outstanding = ATOMIC_INIT(0);
+
+static void lrng_drng_seed_instance_work(struct work_struct *work)
+{
+	struct lrng_seed_instance_work *seed_work =
+		container_of(work, struct lrng_seed_instance_work, work);
+
+	_lrng_drng_seed_work(seed_work->drng, seed_work->node);
+
+	/* The last finishing worker completes the seeding round. */
+	if (atomic_dec_and_test(&lrng_seed_instance_outstanding)) {
+		lrng_drng_seed_round_done();
+		lrng_pool_unlock();
+	}
+}
+
+/*
+ * Dispatch one seed work item per unseeded DRNG instance to an
+ * instance-local CPU.
+ *
+ * Return:
+ * * > 0 workers were dispatched - the last one unlocks the pool
+ * * 0 no instance requires seeding
+ * * < 0 no worker memory - the caller must seed inline
+ */
+static int lrng_drng_seed_instances_dispatch(struct lrng_drng **lrng_drng)
+{
+	u32 node, pending = 0;
+
+	if (!lrng_seed_instance_works) {
+		struct lrng_seed_instance_work *works =
+			kcalloc(lrng_drng_max_instances(), sizeof(*works),
+				GFP_KERNEL);
+
+		if (!works)
+			return -ENOMEM;
+
+		/*
+		 * Initialize all slots, not only the currently online
+		 * instances: an instance whose CPU is offline right now may
+		 * come back online before it is fully seeded and must find
+		 * an initialized work item on a later dispatch.
+		 */
+		for (node = 0; node < lrng_drng_max_instances(); node++)
+			INIT_WORK(&works[node].work,
+				  lrng_drng_seed_instance_work);
+		lrng_seed_instance_works = works;
+	}
+
+	lrng_for_each_drng_instance(node) {
+		struct lrng_drng *drng = lrng_drng[node];
+
+		if (drng && !drng->fully_seeded)
+			pending++;
+	}
+
+	if (!pending)
+		return 0;
+
+	/*
+	 * The instance states only change during seeding which is serialized
+	 * by the pool lock held by the caller - the count taken above thus
+	 * matches the number of workers dispatched below.
+	 */
+	atomic_set(&lrng_seed_instance_outstanding, pending);
+
+	lrng_for_each_drng_instance(node) {
+		struct lrng_seed_instance_work *seed_work =
+			&lrng_seed_instance_works[node];
+		struct lrng_drng *drng = lrng_drng[node];
+		int cpu = lrng_instance_bind_cpu(node);
+
+		if (!drng || drng->fully_seeded)
+			continue;
+
+		seed_work->drng = drng;
+		seed_work->node = node;
+		if (cpu < nr_cpu_ids)
+			schedule_work_on(cpu, &seed_work->work);
+		else
+			/* Memory-only node - any CPU has remote traffic. */
+			schedule_work(&seed_work->work);
+	}
+
+	return pending;
+}
+
 /*
  * DRNG reseed trigger: Kernel thread handler triggered by the schedule_work()
  */
@@ -265,12 +494,30 @@ void lrng_drng_seed_work(struct work_struct *dummy)
 	u32 node;
 
 	if (lrng_drng) {
-		for_each_online_node(node) {
-			struct lrng_drng *drng = lrng_drng[node];
+		/*
+		 * During initial seeding entropy is scarce - retain the
+		 * policy of seeding only the first unseeded instance per
+		 * round so that the available entropy is not split between
+		 * the instances. Once the LRNG is fully seeded, the
+		 * remaining instances are seeded concurrently on their
+		 * local CPUs.
+		 */
+		int ret = lrng_state_fully_seeded() ?
+			  lrng_drng_seed_instances_dispatch(lrng_drng) :
+			  -EAGAIN;
+
+		/* The last finishing worker unlocks the pool. */
+		if (ret > 0)
+			return;
 
-			if (drng && !drng->fully_seeded) {
-				_lrng_drng_seed_work(drng, node);
-				goto out;
+		if (ret < 0) {
+			lrng_for_each_drng_instance(node) {
+				struct lrng_drng *drng = lrng_drng[node];
+
+				if (drng && !drng->fully_seeded) {
+					_lrng_drng_seed_work(drng, node);
+					goto out;
+				}
 			}
 		}
 	} else {
@@ -283,6 +530,7 @@ void lrng_drng_seed_work(struct work_struct *dummy)
 	lrng_pool_all_numa_nodes_seeded(true);
 
 out:
+	lrng_drng_seed_round_done();
 	/* Allow the seeding operation to be called again */
 	lrng_pool_unlock();
 }
@@ -305,18 +553,92 @@ void lrng_drng_force_reseed(void)
 		pr_debug("force reseed of initial DRNG\n");
 		return;
 	}
-	for_each_online_node(node) {
+	lrng_for_each_drng_instance(node) {
 		struct lrng_drng *drng = lrng_drng[node];
 
 		if (!drng)
 			continue;
 
 		drng->force_reseed = drng->fully_seeded;
-		pr_debug("force reseed of DRNG on node %u\n", node);
+		pr_debug("force reseed of DRNG instance %u\n", node);
 	}
 	lrng_drng_atomic.force_reseed = lrng_drng_atomic.fully_seeded;
 }
 
+/*
+ * Adaptive time-based reseed scheduling
+ *
+ * The fixed lrng_drng_reseed_max_time interval is entropy-agnostic: on quiet
+ * systems it forces reseed attempts that walk all per-CPU pools and credit
+ * (nearly) nothing, on busy systems it reseeds more rarely than the
+ * accumulated entropy would allow. The schedule below consults the entropy
+ * accumulated in the collecting entropy sources since the last extraction -
+ * the on-demand sources (CPU, Jitter RNG) are excluded as their entropy level
+ * is constant over time and cannot justify a scheduling decision.
+ *
+ * A reseed is scheduled early once the collecting sources accumulated the
+ * full seed entropy, and the regular interval is deferred while they hold
+ * less than the minimum seed entropy. The deferral is bounded to retain the
+ * periodic state rotation; the volume-based reseed via the request counter
+ * and the forced reseeds are unaffected.
+ */
+#define LRNG_DRNG_RESEED_MIN_TIME	60	/* Early reseed floor <s> */
+#define LRNG_DRNG_RESEED_MAX_DEFER	4	/* Max. deferred intervals */
+
+/* Entropy accumulated in the collecting entropy sources in bits */
+static u32 lrng_drng_collected_entropy(void)
+{
+	return lrng_pcpu_avail_entropy() + lrng_avail_aux_entropy();
+}
+
+static bool lrng_drng_time_reseed_due(struct lrng_drng *drng)
+{
+	unsigned long reseed_jiffies = lrng_drng_reseed_max_time * HZ;
+	u32 collected;
+
+	/*
+	 * The early reseed floor must not override an administrator who
+	 * configured a reseed interval below the floor via the sysctl.
+	 */
+	if (!time_after(jiffies, drng->last_seeded +
+			min_t(unsigned long, LRNG_DRNG_RESEED_MIN_TIME * HZ,
+			      reseed_jiffies)))
+		return false;
+
+	/* The deferral of the regular interval is bounded - see above. */
+	if (time_after(jiffies, drng->last_seeded +
+		       LRNG_DRNG_RESEED_MAX_DEFER * reseed_jiffies))
+		return true;
+
+	/*
+	 * Rate-limit the entropy level query of this instance to once per
+	 * second as it walks the online CPUs while this function runs once
+	 * per generate request. The unsynchronized update of the check time
+	 * stamp is harmless: a race merely causes one redundant query or
+	 * defers the check by another second.
+	 */
+	if (!time_after(jiffies, READ_ONCE(drng->next_ent_check)))
+		return false;
+	WRITE_ONCE(drng->next_ent_check, jiffies + HZ);
+
+	collected = lrng_drng_collected_entropy();
+
+	/*
+	 * Busy system: the full seed entropy accumulated - entropy-wise the
+	 * reseed comes for free, pull it ahead of the regular interval.
+	 */
+	if (collected >= lrng_get_seed_entropy_osr(drng->fully_seeded))
+		return true;
+
+	/*
+	 * Regular interval elapsed: only reseed when the collecting sources
+	 * demonstrably hold the minimum seed entropy - otherwise the pool
+	 * walk is futile and the reseed is deferred.
+	 */
+	return time_after(jiffies, drng->last_seeded + reseed_jiffies) &&
+	       collected >= LRNG_MIN_SEED_ENTROPY_BITS;
+}
+
 /*
  * lrng_drng_get() - Get random data out of the DRNG which is reseeded
  * frequently.
@@ -352,8 +674,7 @@ static int lrng_drng_get(struct lrng_drng *drng, u8 *outbuf, u32 outbuflen)
 		/* All but the atomic DRNG are seeded during generation */
 		if (atomic_dec_and_test(&drng->requests) ||
 		    drng->force_reseed ||
-		    time_after(jiffies, drng->last_seeded +
-			       lrng_drng_reseed_max_time * HZ)) {
+		    lrng_drng_time_reseed_due(drng)) {
 			if (likely(drng != &lrng_drng_atomic)) {
 				if (lrng_pool_trylock()) {
 					drng->force_reseed = true;
@@ -362,6 +683,8 @@ static int lrng_drng_get(struct lrng_drng *drng, u8 *outbuf, u32 outbuflen)
 					lrng_pool_unlock();
 				}
 			}
+		} else {
+			lrng_seed_ahead_schedule(drng);
 		}
 
 		lrng_drng_lock(drng, &flags);
@@ -389,7 +712,7 @@ int lrng_drng_get_sleep(u8 *outbuf, u32 outbuflen)
 {
 	struct lrng_drng **lrng_drng = lrng_drng_instances();
 	struct lrng_drng *drng = &lrng_drng_init;
-	int node = numa_node_id();
+	int node = lrng_drng_curr_instance();
 
 	might_sleep();
 
@@ -412,7 +735,7 @@ static void _lrng_reset(struct work_struct *work)
 	} else {
 		u32 node;
 
-		for_each_online_node(node) {
+		lrng_for_each_drng_instance(node) {
 			struct lrng_drng *drng = lrng_drng[node];
 
 			if (!drng)
@@ -10,6 +10,9 @@
 #include <crypto/hash.h>
 #include <linux/lrng.h>
 #include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/topology.h>
+#include <linux/workqueue.h>
 
 #include "lrng_internal.h"
 
@@ -55,6 +58,149 @@ u32 lrng_archrandom_entropylevel(u32 requested_bits)
 	return lrng_fast_noise_entropylevel(archrandom, requested_bits);
 }
 
+#ifdef CONFIG_LRNG_CPU_PREFETCH
+
+/* Number of machine words held in the buffer of one NUMA node */
+#define LRNG_ARCH_PREFETCH_WORDS	256
+
+/* Backoff of the harvesting worker when the CPU instruction underflows */
+#define LRNG_ARCH_PREFETCH_BACKOFF	HZ
+
+/*
+ * Buffer of opportunistically harvested CPU entropy source data: the
+ * harvesting worker fills the buffer in the background such that the
+ * seeding operation is served with a copy operation instead of issuing one
+ * serializing instruction per machine word. Only data obtained with the
+ * seed-grade instruction is buffered as the buffered data is credited with
+ * the same entropy rate as directly pulled data.
+ */
+struct lrng_arch_prefetch {
+	struct delayed_work work;
+	spinlock_t lock;
+	int node;
+	u32 fill;			/* number of valid words */
+	unsigned long data[LRNG_ARCH_PREFETCH_WORDS];
+};
+
+static struct lrng_arch_prefetch *lrng_arch_prefetch_buf;
+static bool lrng_arch_prefetch_avail;
+
+static void lrng_arch_prefetch_schedule(struct lrng_arch_prefetch *pf,
+					unsigned long delay)
+{
+	int cpu = cpumask_any_and(cpumask_of_node(pf->node), cpu_online_mask);
+
+	/* A node without online CPUs is served by an arbitrary CPU. */
+	if (cpu >= nr_cpu_ids)
+		cpu = cpumask_any(cpu_online_mask);
+
+	schedule_delayed_work_on(cpu, &pf->work, delay);
+}
+
+static void lrng_arch_prefetch_work(struct work_struct *work)
+{
+	struct lrng_arch_prefetch *pf =
+		container_of(to_delayed_work(work), struct lrng_arch_prefetch,
+			     work);
+	unsigned long flags, v;
+	bool full = false;
+
+	while (!full) {
+		if (!arch_get_random_seed_long(&v)) {
+			/*
+			 * The instruction underflowed - retry once the noise
+			 * source of the CPU had time to collect new entropy.
+			 */
+			lrng_arch_prefetch_schedule(pf,
+						    LRNG_ARCH_PREFETCH_BACKOFF);
+			return;
+		}
+
+		spin_lock_irqsave(&pf->lock, flags);
+		if (pf->fill < LRNG_ARCH_PREFETCH_WORDS)
+			pf->data[pf->fill++] = v;
+		full = (pf->fill == LRNG_ARCH_PREFETCH_WORDS);
+		spin_unlock_irqrestore(&pf->lock, flags);
+
+		cond_resched();
+	}
+
+	memzero_explicit(&v, sizeof(v));
+}
+
+/*
+ * Satisfy the request from the node-local buffer. The consumed part of the
+ * buffer is refilled by the harvesting worker in the background.
+ *
+ * Return: amount of data in bits copied to outbuf
+ */
+static u32 lrng_arch_prefetch_get(u8 *outbuf, u32 requested_bits)
+{
+	struct lrng_arch_prefetch *pf;
+	unsigned long flags;
+	u32 words = (requested_bits >> 3) / sizeof(unsigned long), take;
+
+	if (!lrng_arch_prefetch_avail || !words)
+		return 0;
+
+	pf = &lrng_arch_prefetch_buf[numa_node_id()];
+
+	spin_lock_irqsave(&pf->lock, flags);
+	take = min_t(u32, words, pf->fill);
+	pf->fill -= take;
+	memcpy(outbuf, &pf->data[pf->fill], take * sizeof(unsigned long));
+	memzero_explicit(&pf->data[pf->fill], take * sizeof(unsigned long));
+	spin_unlock_irqrestore(&pf->lock, flags);
+
+	if (take)
+		lrng_arch_prefetch_schedule(pf, 0);
+
+	return (u32)(take * sizeof(unsigned long)) << 3;
+}
+
+static int __init lrng_arch_prefetch_init(void)
+{
+	unsigned long v;
+	int node;
+
+	/* Without a seed-grade CPU noise source there is nothing to buffer. */
+	if (!arch_get_random_seed_long(&v))
+		return 0;
+
+	lrng_arch_prefetch_buf = kcalloc(nr_node_ids,
+					 sizeof(*lrng_arch_prefetch_buf),
+					 GFP_KERNEL);
+	if (!lrng_arch_prefetch_buf)
+		return -ENOMEM;
+
+	for_each_node(node) {
+		struct lrng_arch_prefetch *pf = &lrng_arch_prefetch_buf[node];
+
+		pf->node = node;
+		spin_lock_init(&pf->lock);
+		INIT_DELAYED_WORK(&pf->work, lrng_arch_prefetch_work);
+	}
+
+	/* Ensure the initialized state is visible before use. */
+	mb();
+	lrng_arch_prefetch_avail = true;
+
+	for_each_node(node)
+		lrng_arch_prefetch_schedule(&lrng_arch_prefetch_buf[node], 0);
+
+	return 0;
+}
+late_initcall(lrng_arch_prefetch_init);
+
+#else /* CONFIG_LRNG_CPU_PREFETCH */
+
+static inline u32 lrng_arch_prefetch_get(u8 *outbuf, u32 requested_bits)
+{
+	return 0;
+}
+
+#endif /* CONFIG_LRNG_CPU_PREFETCH */
+
 static u32 lrng_get_arch_data(u8 *outbuf, u32 requested_bits)
 {
 	u32 i;
@@ -66,7 +212,9 @@ static u32 lrng_get_arch_data(u8 *outbuf, u32 requested_bits)
 	/* ensure we have aligned buffers */
 	BUILD_BUG_ON(LRNG_KCAPI_ALIGN % sizeof(unsigned long));
 
-	for (i = 0; i < (requested_bits >> 3);
+	/* Serve the leading part of the request from the harvested buffer. */
+	for (i = lrng_arch_prefetch_get(outbuf, requested_bits) >> 3;
+	     i < (requested_bits >> 3);
 	     i += sizeof(unsigned long)) {
 		if (!arch_get_random_seed_long((unsigned long *)(outbuf + i)) &&
 		    !arch_get_random_long((unsigned long *)(outbuf + i))) {
@@ -83,8 +231,8 @@ static u32 inline lrng_get_arch_data_compress(u8 *outbuf, u32 requested_bits,
 {
 	SHASH_DESC_ON_STACK(shash, NULL);
 	const struct lrng_crypto_cb *crypto_cb;
+	const struct lrng_drng_hash *hash_state;
 	struct lrng_drng *drng = lrng_drng_init_instance();
-	unsigned long flags;
 	u32 ent_bits = 0, i, partial_bits = 0,
 	    full_bits = requested_bits * data_multiplier;
 	void *hash;
@@ -99,9 +247,10 @@ static u32 inline lrng_get_arch_data_compress(u8 *outbuf, u32 requested_bits,
 		partial_bits = full_bits - (data_multiplier * requested_bits);
 	}
 
-	lrng_hash_lock(drng, &flags);
-	crypto_cb = drng->crypto_cb;
-	hash = drng->hash;
+	/* Guard the instance-wide hash against replacement */
+	hash_state = lrng_drng_hash_get(drng);
+	crypto_cb = hash_state->crypto_cb;
+	hash = hash_state->hash;
 
 	if (crypto_cb->lrng_hash_init(shash, hash))
 		goto out;
@@ -143,7 +292,7 @@ static u32 inline lrng_get_arch_data_compress(u8 *outbuf, u32 requested_bits,
 
 out:
 	crypto_cb->lrng_hash_desc_zero(shash);
-	lrng_hash_unlock(drng, flags);
+	lrng_drng_hash_put();
 	return ent_bits;
 
 err:
@@ -26,6 +26,12 @@ struct lrng_pool {
 	atomic_t digestsize;		/* Digest size of used hash */
 	bool initialized;		/* Aux pool initialized? */
 
+	/*
+	 * Hash reference the aux pool is operated with - replaced together
+	 * with the conversion of the aux pool state under the pool lock.
+	 */
+	const struct lrng_drng_hash *hash_state;
+
 	/* Serialize read of entropy pool and update of aux pool */
 	spinlock_t lock;
 };
@@ -34,6 +40,7 @@ static struct lrng_pool lrng_pool __aligned(LRNG_KCAPI_ALIGN) = {
 	.aux_entropy_bits	= ATOMIC_INIT(0),
 	.digestsize		= ATOMIC_INIT(LRNG_ATOMIC_DIGEST_SIZE),
 	.initialized		= false,
+	.hash_state		= &lrng_cc20_drng_hash,
 	.lock			= __SPIN_LOCK_UNLOCKED(lrng_pool.lock)
 };
 
@@ -86,45 +93,67 @@ u32 lrng_get_digestsize(void)
 void lrng_pool_set_entropy(u32 entropy_bits)
 {
 	atomic_set(&lrng_pool.aux_entropy_bits, entropy_bits);
+
+	/* The level may have risen above the writer wakeup threshold. */
+	lrng_writer_wakeup_rearm();
 }
 
 /*
  * Replace old with new hash for auxiliary pool handling
  *
- * Assumption: the caller must guarantee that the new_cb is available during the
- * entire operation (e.g. it must hold the write lock against pointer updating).
+ * The conversion of the aux pool state and the replacement of the recorded
+ * hash reference are performed under the pool lock which excludes all users
+ * of the aux pool state.
+ *
+ * Assumption: the caller must guarantee that the new state is available
+ * during the entire operation and that the retired state is only released
+ * after all readers of the hash reference completed (e.g. by waiting for a
+ * grace period).
  */
-int lrng_aux_switch_hash(const struct lrng_crypto_cb *new_cb, void *new_hash,
-			 const struct lrng_crypto_cb *old_cb)
+int lrng_aux_switch_hash(const struct lrng_drng_hash *new_state)
 {
 	struct lrng_pool *pool = &lrng_pool;
 	struct shash_desc *shash = (struct shash_desc *)pool->aux_pool;
+	const struct lrng_drng_hash *old_state;
 	u8 digest[LRNG_MAX_DIGESTSIZE];
-	int ret;
+	unsigned long flags;
+	int ret = 0;
 
 	if (!IS_ENABLED(CONFIG_LRNG_DRNG_SWITCH))
 		return -EOPNOTSUPP;
 
-	if (unlikely(!pool->initialized))
-		return 0;
+	spin_lock_irqsave(&pool->lock, flags);
+
+	old_state = pool->hash_state;
+
+	if (unlikely(!pool->initialized) || old_state == new_state) {
+		/* The pool is initialized with the new reference on use. */
+		pool->hash_state = new_state;
+		goto out;
+	}
 
 	/* Get the aux pool hash with old digest ... */
-	ret = old_cb->lrng_hash_final(shash, digest) ?:
+	ret = old_state->crypto_cb->lrng_hash_final(shash, digest) ?:
 	      /* ... re-initialize the hash with the new digest ... */
-	      new_cb->lrng_hash_init(shash, new_hash) ?:
+	      new_state->crypto_cb->lrng_hash_init(shash, new_state->hash) ?:
 	      /*
 	       * ... feed the old hash into the new state. We may feed
 	       * uninitialized memory into the new state, but this is
 	       * considered no issue and even good as we have some more
 	       * uncertainty here.
 	       */
-	      new_cb->lrng_hash_update(shash, digest, sizeof(digest));
+	      new_state->crypto_cb->lrng_hash_update(shash, digest,
+						     sizeof(digest));
 	if (!ret) {
-		lrng_set_digestsize(new_cb->lrng_hash_digestsize(new_hash));
+		pool->hash_state = new_state;
+		lrng_set_digestsize(new_state->crypto_cb->lrng_hash_digestsize(
+							new_state->hash));
 		pr_debug("Re-initialize aux entropy pool with hash %s\n",
-			 new_cb->lrng_hash_name());
+			 new_state->crypto_cb->lrng_hash_name());
 	}
 
+out:
+	spin_unlock_irqrestore(&pool->lock, flags);
 	memzero_explicit(digest, sizeof(digest));
 	return ret;
 }
@@ -135,18 +164,15 @@ lrng_pool_insert_aux_locked(const u8 *inbuf, u32 inbuflen, u32 entropy_bits)
 {
 	struct lrng_pool *pool = &lrng_pool;
 	struct shash_desc *shash = (struct shash_desc *)pool->aux_pool;
-	struct lrng_drng *drng = lrng_drng_init_instance();
 	const struct lrng_crypto_cb *crypto_cb;
-	unsigned long flags;
 	void *hash;
 	int ret;
 
 	entropy_bits = min_t(u32, entropy_bits, inbuflen << 3);
 
-	lrng_hash_lock(drng, &flags);
-
-	crypto_cb = drng->crypto_cb;
-	hash = drng->hash;
+	/* The reference is only replaced under the pool lock held by caller */
+	crypto_cb = pool->hash_state->crypto_cb;
+	hash = pool->hash_state->hash;
 
 	if (unlikely(!pool->initialized)) {
 		ret = crypto_cb->lrng_hash_init(shash, hash);
@@ -169,19 +195,142 @@ lrng_pool_insert_aux_locked(const u8 *inbuf, u32 inbuflen, u32 entropy_bits)
 			 crypto_cb->lrng_hash_digestsize(hash) << 3));
 
 out:
-	lrng_hash_unlock(drng, flags);
 	return ret;
 }
 
+/*
+ * Staging ring in front of the auxiliary pool
+ *
+ * add_device_randomness() inserts into the aux pool for every device probed
+ * which amounts to thousands of insertions during parallelized driver
+ * probing, all contending lrng_pool.lock and each paying the hash update
+ * latency with interrupts disabled. The multi-producer single-consumer ring
+ * decouples the two: producers copy their data into a slot claimed with one
+ * atomic compare-and-swap and return, while the current pool lock holder
+ * batch-hashes all accumulated records in a single locked pass.
+ *
+ * The data is copied as the callers only guarantee the validity of their
+ * buffers for the duration of the call. A record is published by storing its
+ * non-zero length with release semantics; the consumer, serialized by
+ * lrng_pool.lock, stops at the first unpublished slot and re-visits it
+ * during the next drain pass.
+ */
+#define LRNG_AUX_STAGE_SLOTS	128	/* Must be a power of two */
+#define LRNG_AUX_STAGE_DATASIZE	64
+
+struct lrng_aux_stage_slot {
+	u32 len;		/* Non-zero length publishes the record */
+	u32 entropy_bits;
+	u8 data[LRNG_AUX_STAGE_DATASIZE];
+};
+
+struct lrng_aux_stage {
+	struct lrng_aux_stage_slot slots[LRNG_AUX_STAGE_SLOTS];
+	atomic_t head;		/* Producer claim counter */
+	u32 tail;		/* Consumer position - under lrng_pool.lock */
+};
+
+static struct lrng_aux_stage lrng_aux_stage;
+
+/*
+ * Stage one record. Returns false if the record does not fit into a slot or
+ * the ring is full in which case the caller must take the direct path.
+ */
+static bool lrng_aux_stage_insert(const u8 *inbuf, u32 inbuflen,
+				  u32 entropy_bits)
+{
+	struct lrng_aux_stage *stage = &lrng_aux_stage;
+	struct lrng_aux_stage_slot *slot;
+	u32 head;
+
+	if (inbuflen > LRNG_AUX_STAGE_DATASIZE)
+		return false;
+
+	/* Nothing to hash - the entropy would be capped to zero anyway. */
+	if (!inbuflen)
+		return true;
+
+	/*
+	 * Claim a slot. The acquire on the consumer position pairs with the
+	 * release in lrng_aux_stage_drain() and guarantees that a slot the
+	 * consumer moved past is observed with a cleared length.
+	 */
+	do {
+		head = atomic_read_u32(&stage->head);
+		if (head - smp_load_acquire(&stage->tail) >=
+		    LRNG_AUX_STAGE_SLOTS)
+			return false;
+	} while (atomic_cmpxchg(&stage->head, head, head + 1) != head);
+
+	slot = &stage->slots[head & (LRNG_AUX_STAGE_SLOTS - 1)];
+	memcpy(slot->data, inbuf, inbuflen);
+	slot->entropy_bits = entropy_bits;
+	/* Publish the complete record to the consumer. */
+	smp_store_release(&slot->len, inbuflen);
+
+	return true;
+}
+
+/*
+ * Batch-hash all published records into the aux pool.
+ * Caller must hold lrng_pool.lock which serializes all consumers.
+ */
+static void lrng_aux_stage_drain(void)
+{
+	struct lrng_aux_stage *stage = &lrng_aux_stage;
+	u32 tail = stage->tail;
+
+	while (tail != atomic_read_u32(&stage->head)) {
+		struct lrng_aux_stage_slot *slot =
+			&stage->slots[tail & (LRNG_AUX_STAGE_SLOTS - 1)];
+		u32 len = smp_load_acquire(&slot->len);
+
+		/* Claimed, but not yet published - re-visited next drain. */
+		if (!len)
+			break;
+
+		lrng_pool_insert_aux_locked(slot->data, len,
+					    slot->entropy_bits);
+		memzero_explicit(slot->data, len);
+		WRITE_ONCE(slot->len, 0);
+		/* Release the slot for re-use by the producers. */
+		smp_store_release(&stage->tail, ++tail);
+	}
+}
+
 int lrng_pool_insert_aux(const u8 *inbuf, u32 inbuflen, u32 entropy_bits)
 {
 	struct lrng_pool *pool = &lrng_pool;
 	unsigned long flags;
-	int ret;
+	int ret = 0;
 
-	spin_lock_irqsave(&pool->lock, flags);
-	ret = lrng_pool_insert_aux_locked(inbuf, inbuflen, entropy_bits);
-	spin_unlock_irqrestore(&pool->lock, flags);
+	/*
+	 * Entropy-credited insertions take the direct path so that the
+	 * credit is accounted and hash errors are reported when the caller
+	 * returns - the insertion storms consist of uncredited data.
+	 */
+	if (!entropy_bits &&
+	    lrng_aux_stage_insert(inbuf, inbuflen, entropy_bits)) {
+		/*
+		 * Hash the staged records if nobody operates the pool
+		 * concurrently - otherwise the current lock holder picks
+		 * the record up in its own drain pass.
+		 */
+		if (spin_trylock_irqsave(&pool->lock, flags)) {
+			lrng_aux_stage_drain();
+			spin_unlock_irqrestore(&pool->lock, flags);
+		}
+	} else {
+		spin_lock_irqsave(&pool->lock, flags);
+		/* Drain first to free the ring when it overflowed. */
+		lrng_aux_stage_drain();
+		ret = lrng_pool_insert_aux_locked(inbuf, inbuflen,
+						  entropy_bits);
+		spin_unlock_irqrestore(&pool->lock, flags);
+	}
+
+	/* The insertion may have raised the level above the threshold. */
+	lrng_writer_wakeup_rearm();
 
 	lrng_pool_add_entropy();
 
@@ -201,9 +350,7 @@ static inline u32 lrng_get_aux_pool(u8 *outbuf, u32 requested_bits)
 {
 	struct lrng_pool *pool = &lrng_pool;
 	struct shash_desc *shash = (struct shash_desc *)pool->aux_pool;
-	struct lrng_drng *drng = lrng_drng_init_instance();
 	const struct lrng_crypto_cb *crypto_cb;
-	unsigned long flags;
 	void *hash;
 	u32 collected_ent_bits, returned_ent_bits, unused_bits = 0,
 	    digestsize;
@@ -212,10 +359,9 @@ static inline u32 lrng_get_aux_pool(u8 *outbuf, u32 requested_bits)
 	if (unlikely(!pool->initialized))
 		return 0;
 
-	lrng_hash_lock(drng, &flags);
-
-	crypto_cb = drng->crypto_cb;
-	hash = drng->hash;
+	/* The reference is only replaced under the pool lock held by caller */
+	crypto_cb = pool->hash_state->crypto_cb;
+	hash = pool->hash_state->hash;
 	digestsize = crypto_cb->lrng_hash_digestsize(hash);
 
 	/* Ensure that no more than the size of aux_pool can be requested */
@@ -259,7 +405,6 @@ static inline u32 lrng_get_aux_pool(u8 *outbuf, u32 requested_bits)
 		memcpy(outbuf, aux_output, requested_bits >> 3);
 	}
 
-	lrng_hash_unlock(drng, flags);
 	memzero_explicit(aux_output, digestsize);
 	return returned_ent_bits;
 }
@@ -272,6 +417,9 @@ void lrng_get_backtrack_aux(struct entropy_buf *entropy_buf, u32 requested_bits)
 	/* Ensure aux pool extraction and backtracking op are atomic */
 	spin_lock_irqsave(&pool->lock, flags);
 
+	/* Hash all staged records so that their entropy is extractable. */
+	lrng_aux_stage_drain();
+
 	entropy_buf->a_bits = lrng_get_aux_pool(entropy_buf->a, requested_bits);
 
 	/* Mix the extracted data back into pool for backtracking resistance */
@@ -13,6 +13,9 @@
 #include <linux/gcd.h>
 #include <linux/lrng.h>
 #include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/topology.h>
+#include <linux/workqueue.h>
 
 #include "lrng_internal.h"
 #include "lrng_es_irq.h"
@@ -41,7 +44,7 @@ MODULE_PARM_DESC(irq_entropy,
 
 /* Per-CPU array holding concatenated entropy events */
 static DEFINE_PER_CPU(u32 [LRNG_DATA_ARRAY_SIZE], lrng_pcpu_array)
-						__aligned(LRNG_KCAPI_ALIGN);
+						__aligned(LRNG_DATA_ARRAY_ALIGN);
 static DEFINE_PER_CPU(u32, lrng_pcpu_array_ptr) = 0;
 static DEFINE_PER_CPU(atomic_t, lrng_pcpu_array_irqs) = ATOMIC_INIT(0);
 
@@ -94,6 +97,18 @@ static DEFINE_PER_CPU(u8 [LRNG_POOL_SIZE], lrng_pcpu_pool)
 static DEFINE_PER_CPU(spinlock_t, lrng_pcpu_lock);
 static DEFINE_PER_CPU(bool, lrng_pcpu_lock_init) = false;
 
+/*
+ * Hash reference the per-CPU entropy pool was last operated with. The
+ * reference is replaced together with the conversion of the pool state under
+ * the per-CPU pool lock which guarantees that the crypto callbacks always
+ * match the state of the pool they are applied to.
+ */
+static DEFINE_PER_CPU(struct lrng_drng_hash *, lrng_pcpu_hash_state) =
+							&lrng_cc20_drng_hash;
+
+/* Serialize registration of new per-CPU pools against a hash replacement. */
+static DEFINE_SPINLOCK(lrng_pcpu_hash_switch_lock);
+
 /* Number of time stamps analyzed to calculate a GCD */
 #define LRNG_GCD_WINDOW_SIZE	100
 static u32 lrng_gcd_history[LRNG_GCD_WINDOW_SIZE];
@@ -102,6 +117,22 @@ static atomic_t lrng_gcd_history_ptr = ATOMIC_INIT(-1);
 /* The common divisor for all timestamps */
 static u32 lrng_gcd_timer = 0;
 
+/*
+ * Shift scaling the time stamps by the power-of-two component of the GCD.
+ *
+ * The scaled time stamp is truncated to the low LRNG_DATA_SLOTSIZE_BITS bits.
+ * The odd component of the GCD is an invertible multiplier modulo the
+ * truncation width, thus it neither adds nor removes variations from the
+ * truncated value and does not need to be divided out. Only the power-of-two
+ * component shifts variations out of the truncation window which reduces the
+ * per-interrupt division to a shift.
+ */
+static u32 lrng_gcd_shift = 0;
+
+/* Sampling interval per CPU of the online GCD recalibration */
+#define LRNG_GCD_RECAL_INTERVAL	(1 << 13)
+static DEFINE_PER_CPU(u32, lrng_gcd_sample_cnt) = 0;
+
 static inline bool lrng_gcd_tested(void)
 {
 	return (lrng_gcd_timer != 0);
@@ -111,14 +142,16 @@ static inline bool lrng_gcd_tested(void)
 static inline void _lrng_gcd_set(u32 running_gcd)
 {
 	lrng_gcd_timer = running_gcd;
+	lrng_gcd_shift = running_gcd ? ffs(running_gcd) - 1 : 0;
 	mb();
 }
 
 static void lrng_gcd_set(u32 running_gcd)
 {
-	if (!lrng_gcd_tested()) {
+	if (!lrng_gcd_tested() || running_gcd != lrng_gcd_timer) {
 		_lrng_gcd_set(running_gcd);
-		pr_debug("Setting GCD to %u\n", running_gcd);
+		pr_debug("Setting GCD to %u (scaling shift %u)\n", running_gcd,
+			 lrng_gcd_shift);
 	}
 }
 
@@ -225,8 +258,8 @@ static int __init lrng_init_time_source(void)
 	/* Set a minimum number of interrupts that must be collected */
 	irq_entropy = max_t(u32, LRNG_IRQ_ENTROPY_BITS, irq_entropy);
 
-	if ((random_get_entropy() & LRNG_DATA_SLOTSIZE_MASK) ||
-	    (random_get_entropy() & LRNG_DATA_SLOTSIZE_MASK)) {
+	if ((random_get_entropy() & LRNG_DATA_HIGHRES_MASK) ||
+	    (random_get_entropy() & LRNG_DATA_HIGHRES_MASK)) {
 		/*
 		 * As the highres timer is identified here, previous interrupts
 		 * obtained during boot time are treated like a lowres-timer
@@ -311,57 +344,96 @@ u32 lrng_pcpu_avail_entropy(void)
 /*
  * Trigger a switch of the hash implementation for the per-CPU pool.
  *
- * For each per-CPU pool, obtain the message digest with the old hash
- * implementation, initialize the per-CPU pool again with the new hash
- * implementation and inject the message digest into the new state.
+ * The new hash reference is published for the DRNG instance before the
+ * per-CPU pools are converted: a pool that registers itself concurrently
+ * either is converted by the loop below or already starts out with the new
+ * reference as both operations are serialized with the registration lock.
+ *
+ * For each per-CPU pool, obtain the message digest with the hash
+ * implementation recorded for the pool, initialize the per-CPU pool again
+ * with the new hash implementation and inject the message digest into the
+ * new state. The conversion is performed under the per-CPU pool lock which
+ * excludes all users of the pool state.
  *
- * Assumption: the caller must guarantee that the new_cb is available during the
- * entire operation (e.g. it must hold the lock against pointer updating).
+ * Assumption: the caller must guarantee that the new state is available
+ * during the entire operation and that the retired state is only released
+ * after all readers of the hash reference completed (e.g. by waiting for a
+ * grace period).
  */
-int lrng_pcpu_switch_hash(int node,
-			  const struct lrng_crypto_cb *new_cb, void *new_hash,
-			  const struct lrng_crypto_cb *old_cb)
+int lrng_pcpu_switch_hash(struct lrng_drng *drng, int node,
+			  struct lrng_drng_hash *new_state)
 {
+	struct lrng_drng_hash *old_inst_state;
 	u8 digest[LRNG_MAX_DIGESTSIZE];
 	u32 digestsize_irqs, found_irqs;
+	unsigned long flags;
 	int ret = 0, cpu;
 
 	if (!IS_ENABLED(CONFIG_LRNG_DRNG_SWITCH))
 		return -EOPNOTSUPP;
 
-	for_each_online_cpu(cpu) {
+	spin_lock_irqsave(&lrng_pcpu_hash_switch_lock, flags);
+
+	old_inst_state = rcu_dereference_protected(drng->hash_state,
+			lockdep_is_held(&lrng_pcpu_hash_switch_lock));
+	rcu_assign_pointer(drng->hash_state, new_state);
+
+	/*
+	 * Convert the pools of all CPUs - including the pools of currently
+	 * offline CPUs - such that no pool retains a reference to the state
+	 * that is retired with the switch operation.
+	 */
+	for_each_possible_cpu(cpu) {
+		const struct lrng_drng_hash *old_state;
 		struct shash_desc *pcpu_shash;
+		spinlock_t *lock;
 
 		/*
-		 * Only switch the per-CPU pools for the current node because
-		 * the crypto_cb only applies NUMA-node-wide.
+		 * Only switch the per-CPU pools belonging to the current DRNG
+		 * instance because the crypto_cb only applies instance-wide,
+		 * i.e. NUMA-node-wide or CPU-wide for per-CPU DRNG instances.
 		 */
-		if (cpu_to_node(cpu) != node || !lrng_pcpu_pool_online(cpu))
+		if (lrng_cpu_to_instance(cpu) != node ||
+		    !lrng_pcpu_pool_online(cpu))
 			continue;
 
 		pcpu_shash = (struct shash_desc *)per_cpu_ptr(lrng_pcpu_pool,
 							      cpu);
+		lock = per_cpu_ptr(&lrng_pcpu_lock, cpu);
 
-		digestsize_irqs = old_cb->lrng_hash_digestsize(pcpu_shash);
-		digestsize_irqs = lrng_entropy_to_data(digestsize_irqs << 3);
+		spin_lock(lock);
 
-		if (pcpu_shash->tfm == new_hash)
+		old_state = *per_cpu_ptr(&lrng_pcpu_hash_state, cpu);
+		if (old_state == new_state) {
+			spin_unlock(lock);
 			continue;
+		}
+
+		digestsize_irqs = old_state->crypto_cb->lrng_hash_digestsize(
+							old_state->hash);
+		digestsize_irqs = lrng_entropy_to_data(digestsize_irqs << 3);
 
 		/* Get the per-CPU pool hash with old digest ... */
-		ret = old_cb->lrng_hash_final(pcpu_shash, digest) ?:
+		ret = old_state->crypto_cb->lrng_hash_final(pcpu_shash,
+							    digest) ?:
 		      /* ... re-initialize the hash with the new digest ... */
-		      new_cb->lrng_hash_init(pcpu_shash, new_hash) ?:
+		      new_state->crypto_cb->lrng_hash_init(pcpu_shash,
+							   new_state->hash) ?:
 		      /*
 		       * ... feed the old hash into the new state. We may feed
 		       * uninitialized memory into the new state, but this is
 		       * considered no issue and even good as we have some more
 		       * uncertainty here.
 		       */
-		      new_cb->lrng_hash_update(pcpu_shash, digest,
-					       sizeof(digest));
-		if (ret)
+		      new_state->crypto_cb->lrng_hash_update(pcpu_shash,
+							     digest,
+							     sizeof(digest));
+		if (ret) {
+			spin_unlock(lock);
 			goto out;
+		}
+
+		*per_cpu_ptr(&lrng_pcpu_hash_state, cpu) = new_state;
 
 		/*
 		 * In case the new digest is larger than the old one, cap
@@ -374,33 +446,50 @@ int lrng_pcpu_switch_hash(int node,
 		atomic_add_return_relaxed(found_irqs,
 				per_cpu_ptr(&lrng_pcpu_array_irqs, cpu));
 
+		spin_unlock(lock);
+
 		pr_debug("Re-initialize per-CPU entropy pool for CPU %d on NUMA node %d with hash %s\n",
-			 cpu, node, new_cb->lrng_hash_name());
+			 cpu, node, new_state->crypto_cb->lrng_hash_name());
 	}
 
 out:
+	/*
+	 * Revert the publication in the error case - pools already converted
+	 * keep the new reference which remains valid as the new state is not
+	 * released by the caller on error.
+	 */
+	if (ret)
+		rcu_assign_pointer(drng->hash_state, old_inst_state);
+
+	spin_unlock_irqrestore(&lrng_pcpu_hash_switch_lock, flags);
 	memzero_explicit(digest, sizeof(digest));
 	return ret;
 }
 
 /*
- * When reading the per-CPU message digest, make sure we use the crypto
- * callbacks defined for the NUMA node the per-CPU pool is defined for because
- * the LRNG crypto switch support is only atomic per NUMA node.
+ * When reading the per-CPU message digest, use the crypto callbacks recorded
+ * with the per-CPU pool - the record is only replaced together with the
+ * conversion of the pool state under the per-CPU pool lock taken below.
  */
 static inline u32
-lrng_pcpu_pool_hash_one(const struct lrng_crypto_cb *pcpu_crypto_cb,
-			void *pcpu_hash, int cpu, u8 *digest, u32 *digestsize)
+lrng_pcpu_pool_hash_one(int cpu, u8 *digest, u32 *digestsize)
 {
 	struct shash_desc *pcpu_shash =
 		(struct shash_desc *)per_cpu_ptr(lrng_pcpu_pool, cpu);
 	spinlock_t *lock = per_cpu_ptr(&lrng_pcpu_lock, cpu);
+	const struct lrng_crypto_cb *pcpu_crypto_cb;
+	const struct lrng_drng_hash *hash_state;
 	unsigned long flags;
 	u32 digestsize_irqs, found_irqs;
+	void *pcpu_hash;
 
 	/* Lock guarding against reading / writing to per-CPU pool */
 	spin_lock_irqsave(lock, flags);
 
+	hash_state = *per_cpu_ptr(&lrng_pcpu_hash_state, cpu);
+	pcpu_crypto_cb = hash_state->crypto_cb;
+	pcpu_hash = hash_state->hash;
+
 	*digestsize = pcpu_crypto_cb->lrng_hash_digestsize(pcpu_hash);
 	digestsize_irqs = lrng_entropy_to_data(*digestsize << 3);
 
@@ -411,13 +500,16 @@ lrng_pcpu_pool_hash_one(const struct lrng_crypto_cb *pcpu_crypto_cb,
 	found_irqs = min_t(u32, found_irqs, digestsize_irqs);
 
 	/* Cap to maximum amount of data we can hold in array */
-	if (!lrng_pcpu_continuous_compression)
+	if (!lrng_pcpu_continuous_compression &&
+	    !IS_ENABLED(CONFIG_LRNG_LFSR_PREMIX))
 		found_irqs = min_t(u32, found_irqs, LRNG_DATA_NUM_VALUES);
 
 	/* Store all not-yet compressed data in data array into hash, ... */
 	if (pcpu_crypto_cb->lrng_hash_update(pcpu_shash,
 				(u8 *)per_cpu_ptr(lrng_pcpu_array, cpu),
 				LRNG_DATA_ARRAY_SIZE * sizeof(u32)) ?:
+	    /* ... condition the LFSR pre-mix pool into the hash, ... */
+	    lrng_pcpu_lfsr_hash(cpu, pcpu_crypto_cb, pcpu_shash) ?:
 	    /* ... get the per-CPU pool digest, ... */
 	    pcpu_crypto_cb->lrng_hash_final(pcpu_shash, digest) ?:
 	    /* ... re-initialize the hash, ... */
@@ -448,24 +540,24 @@ lrng_pcpu_pool_hash_one(const struct lrng_crypto_cb *pcpu_crypto_cb,
  * @fully_seeded: indicator whether LRNG is fully seeded
  * @return: amount of entropy in outbuf in bits.
  */
-u32 lrng_pcpu_pool_hash(u8 *outbuf, u32 requested_bits, bool fully_seeded)
+static u32 lrng_pcpu_pool_hash_serial(u8 *outbuf, u32 requested_bits,
+				      bool fully_seeded)
 {
 	SHASH_DESC_ON_STACK(shash, NULL);
 	const struct lrng_crypto_cb *crypto_cb;
-	struct lrng_drng **lrng_drng = lrng_drng_instances();
+	const struct lrng_drng_hash *hash_state;
 	struct lrng_drng *drng = lrng_drng_init_instance();
 	u8 digest[LRNG_MAX_DIGESTSIZE];
-	unsigned long flags, flags2;
 	u32 found_irqs, collected_irqs = 0, collected_ent_bits, requested_irqs,
 	    returned_ent_bits;
 	int ret, cpu;
 	void *hash;
 
-	/* Lock guarding replacement of per-NUMA hash */
-	lrng_hash_lock(drng, &flags);
+	/* Guard the instance-wide hash against replacement */
+	hash_state = lrng_drng_hash_get(drng);
 
-	crypto_cb = drng->crypto_cb;
-	hash = drng->hash;
+	crypto_cb = hash_state->crypto_cb;
+	hash = hash_state->hash;
 
 	/* The hash state of filled with all per-CPU pool hashes. */
 	ret = crypto_cb->lrng_hash_init(shash, hash);
@@ -480,29 +572,13 @@ u32 lrng_pcpu_pool_hash(u8 *outbuf, u32 requested_bits, bool fully_seeded)
 	 * have collected sufficient entropy, we will hash all per-CPU pools.
 	 */
 	for_each_online_cpu(cpu) {
-		struct lrng_drng *pcpu_drng = drng;
 		u32 digestsize, pcpu_unused_irqs = 0;
-		int node = cpu_to_node(cpu);
 
 		/* If pool is not online, then no entropy is present. */
 		if (!lrng_pcpu_pool_online(cpu))
 			continue;
 
-		if (lrng_drng && lrng_drng[node])
-			pcpu_drng = lrng_drng[node];
-
-		if (pcpu_drng == drng) {
-			found_irqs = lrng_pcpu_pool_hash_one(crypto_cb, hash,
-							     cpu, digest,
-							     &digestsize);
-		} else {
-			lrng_hash_lock(pcpu_drng, &flags2);
-			found_irqs =
-				lrng_pcpu_pool_hash_one(pcpu_drng->crypto_cb,
-							pcpu_drng->hash, cpu,
-							digest, &digestsize);
-			lrng_hash_unlock(pcpu_drng, flags2);
-		}
+		found_irqs = lrng_pcpu_pool_hash_one(cpu, digest, &digestsize);
 
 		/* Inject the digest into the state of all per-CPU pools */
 		ret = crypto_cb->lrng_hash_update(shash, digest, digestsize);
@@ -549,7 +625,7 @@ u32 lrng_pcpu_pool_hash(u8 *outbuf, u32 requested_bits, bool fully_seeded)
 
 out:
 	crypto_cb->lrng_hash_desc_zero(shash);
-	lrng_hash_unlock(drng, flags);
+	lrng_drng_hash_put();
 	memzero_explicit(digest, sizeof(digest));
 	return returned_ent_bits;
 
@@ -558,52 +634,507 @@ err:
 	goto out;
 }
 
-/* Compress the lrng_pcpu_array array into lrng_pcpu_pool */
-static inline void lrng_pcpu_array_compress(void)
+#ifdef CONFIG_LRNG_NODE_HASH_REDUCTION
+
+struct lrng_node_hash {
+	struct work_struct work;
+	int node;		/* NUMA node covered by this worker */
+	int cpu;		/* CPU the worker was scheduled on */
+	int ret;		/* Result of the partial hash operation */
+	bool scheduled;		/* Was the worker scheduled this round? */
+	u32 found_irqs;		/* Events collected by this node's pools */
+	u32 digestsize;		/* Size of the cached partial digest */
+	/* Partial digest - cached between reseeds */
+	u8 digest[LRNG_MAX_DIGESTSIZE];
+};
+
+static struct lrng_node_hash *lrng_node_hashes;
+static bool lrng_node_hash_avail __read_mostly = false;
+/* Lock guarding the per-node state against concurrent reductions */
+static DEFINE_MUTEX(lrng_node_hash_lock);
+
+/* Return number of unprocessed events in all per-CPU arrays of a node. */
+static u32 lrng_pcpu_node_pending_irqs(int node)
 {
-	struct shash_desc *shash =
-			(struct shash_desc *)this_cpu_ptr(lrng_pcpu_pool);
+	u32 irqs = 0;
+	int cpu;
+
+	for_each_online_cpu(cpu) {
+		if (cpu_to_node(cpu) != node || !lrng_pcpu_pool_online(cpu))
+			continue;
+		irqs += atomic_read_u32(per_cpu_ptr(&lrng_pcpu_array_irqs,
+						    cpu));
+	}
+
+	return irqs;
+}
+
+/*
+ * Reduce the entropy pools of all CPUs of one NUMA node into one partial
+ * digest. The worker executes on a CPU of that node which keeps the access
+ * to the per-CPU pools node-local.
+ */
+static void lrng_pcpu_node_hash_work(struct work_struct *work)
+{
+	struct lrng_node_hash *node_hash =
+			container_of(work, struct lrng_node_hash, work);
+	SHASH_DESC_ON_STACK(shash, NULL);
+	const struct lrng_crypto_cb *crypto_cb;
+	const struct lrng_drng_hash *hash_state;
 	struct lrng_drng **lrng_drng = lrng_drng_instances();
 	struct lrng_drng *drng = lrng_drng_init_instance();
+	u8 digest[LRNG_MAX_DIGESTSIZE];
+	u32 digestsize;
+	int cpu, ret;
+	void *hash;
+
+	node_hash->found_irqs = 0;
+
+	/*
+	 * Without new events on this node, reuse the cached partial digest.
+	 * It claims no entropy and only retains the node's contribution in
+	 * the final digest.
+	 */
+	if (node_hash->digestsize &&
+	    !lrng_pcpu_node_pending_irqs(node_hash->node)) {
+		node_hash->ret = 0;
+		return;
+	}
+
+	if (lrng_drng && lrng_drng[node_hash->node])
+		drng = lrng_drng[node_hash->node];
+
+	/* Guard the instance-wide hash against replacement */
+	hash_state = lrng_drng_hash_get(drng);
+	crypto_cb = hash_state->crypto_cb;
+	hash = hash_state->hash;
+
+	ret = crypto_cb->lrng_hash_init(shash, hash);
+	if (ret)
+		goto out;
+
+	for_each_online_cpu(cpu) {
+		u32 found_irqs;
+
+		if (cpu_to_node(cpu) != node_hash->node ||
+		    !lrng_pcpu_pool_online(cpu))
+			continue;
+
+		found_irqs = lrng_pcpu_pool_hash_one(cpu, digest, &digestsize);
+
+		ret = crypto_cb->lrng_hash_update(shash, digest, digestsize);
+		if (ret)
+			goto out;
+
+		node_hash->found_irqs += found_irqs;
+	}
+
+	ret = crypto_cb->lrng_hash_final(shash, node_hash->digest);
+	if (!ret)
+		node_hash->digestsize = crypto_cb->lrng_hash_digestsize(hash);
+
+out:
+	crypto_cb->lrng_hash_desc_zero(shash);
+	lrng_drng_hash_put();
+	memzero_explicit(digest, sizeof(digest));
+	node_hash->ret = ret;
+}
+
+/*
+ * Hierarchical reduction of the per-CPU entropy pools: fan out one worker
+ * per NUMA node computing a node-local partial digest and combine the
+ * partial digests into the final digest. The reseed cost scales with the
+ * number of nodes instead of the number of CPUs.
+ */
+u32 lrng_pcpu_pool_hash(u8 *outbuf, u32 requested_bits, bool fully_seeded)
+{
+	SHASH_DESC_ON_STACK(shash, NULL);
 	const struct lrng_crypto_cb *crypto_cb;
-	spinlock_t *lock = this_cpu_ptr(&lrng_pcpu_lock);
-	unsigned long flags, flags2;
-	int node = numa_node_id();
+	const struct lrng_drng_hash *hash_state;
+	struct lrng_drng *drng = lrng_drng_init_instance();
+	u8 digest[LRNG_MAX_DIGESTSIZE];
+	u32 collected_irqs = 0, collected_ent_bits, requested_irqs,
+	    returned_ent_bits;
+	int ret, node;
 	void *hash;
-	bool init = false;
 
-	/* Get NUMA-node local hash instance */
-	if (lrng_drng && lrng_drng[node])
-		drng = lrng_drng[node];
+	/*
+	 * Fall back to the serial operation before the workers are set up
+	 * during boot or when only one node is present.
+	 */
+	if (!lrng_node_hash_avail || num_online_nodes() <= 1)
+		return lrng_pcpu_pool_hash_serial(outbuf, requested_bits,
+						  fully_seeded);
+
+	/* Concurrent reductions share the per-node state - serialize them. */
+	mutex_lock(&lrng_node_hash_lock);
+
+	/* Fan out the partial hashing to one node-local CPU per node. */
+	for_each_online_node(node) {
+		struct lrng_node_hash *node_hash = lrng_node_hashes + node;
+		int cpu = cpumask_any_and(cpumask_of_node(node),
+					  cpu_online_mask);
+
+		node_hash->scheduled = false;
+		if (cpu >= nr_cpu_ids)
+			continue;
+
+		node_hash->cpu = cpu;
+		node_hash->scheduled = true;
+		schedule_work_on(cpu, &node_hash->work);
+	}
+
+	for_each_online_node(node) {
+		if (lrng_node_hashes[node].scheduled)
+			flush_work(&lrng_node_hashes[node].work);
+	}
+
+	/* Guard the instance-wide hash against replacement */
+	hash_state = lrng_drng_hash_get(drng);
 
-	lrng_hash_lock(drng, &flags);
-	crypto_cb = drng->crypto_cb;
-	hash = drng->hash;
+	crypto_cb = hash_state->crypto_cb;
+	hash = hash_state->hash;
+
+	/* The hash state is filled with all per-node partial digests. */
+	ret = crypto_cb->lrng_hash_init(shash, hash);
+	if (ret)
+		goto err;
+
+	requested_irqs = lrng_entropy_to_data(requested_bits +
+					      lrng_compress_osr());
+
+	for_each_online_node(node) {
+		struct lrng_node_hash *node_hash = lrng_node_hashes + node;
+		u32 unused_irqs = 0;
+
+		if (!node_hash->scheduled || node_hash->ret ||
+		    !node_hash->digestsize)
+			continue;
+
+		/* Combine the partial digest into the final digest. */
+		ret = crypto_cb->lrng_hash_update(shash, node_hash->digest,
+						  node_hash->digestsize);
+		if (ret)
+			goto err;
+
+		collected_irqs += node_hash->found_irqs;
+		if (collected_irqs > requested_irqs) {
+			unused_irqs = collected_irqs - requested_irqs;
+			atomic_add_return_relaxed(unused_irqs,
+				per_cpu_ptr(&lrng_pcpu_array_irqs,
+					    node_hash->cpu));
+			collected_irqs = requested_irqs;
+		}
+		pr_debug("%u interrupts used from entropy pools of NUMA node %d, %u interrupts remain unused\n",
+			 node_hash->found_irqs - unused_irqs, node,
+			 unused_irqs);
+	}
+
+	ret = crypto_cb->lrng_hash_final(shash, digest);
+	if (ret)
+		goto err;
+
+	collected_ent_bits = lrng_data_to_entropy(collected_irqs);
+	/* Cap to maximum entropy that can ever be generated with given hash */
+	collected_ent_bits = min_t(u32, collected_ent_bits,
+				   crypto_cb->lrng_hash_digestsize(hash) << 3);
+	/* Apply oversampling: discount requested oversampling rate */
+	returned_ent_bits = lrng_reduce_by_osr(collected_ent_bits);
+
+	pr_debug("obtained %u bits by collecting %u bits of entropy from entropy pool noise source\n",
+		 returned_ent_bits, collected_ent_bits);
+
+	/* See lrng_pcpu_pool_hash_serial for the truncation rationale. */
+	memcpy(outbuf, digest, fully_seeded ? returned_ent_bits >> 3 :
+					      requested_bits >> 3);
+
+out:
+	crypto_cb->lrng_hash_desc_zero(shash);
+	lrng_drng_hash_put();
+	mutex_unlock(&lrng_node_hash_lock);
+	memzero_explicit(digest, sizeof(digest));
+	return returned_ent_bits;
+
+err:
+	returned_ent_bits = 0;
+	goto out;
+}
+
+static int __init lrng_node_hash_init(void)
+{
+	int node;
+
+	if (num_possible_nodes() <= 1)
+		return 0;
+
+	lrng_node_hashes = kcalloc(nr_node_ids, sizeof(*lrng_node_hashes),
+				   GFP_KERNEL);
+	if (!lrng_node_hashes)
+		return -ENOMEM;
+
+	for (node = 0; node < nr_node_ids; node++) {
+		lrng_node_hashes[node].node = node;
+		INIT_WORK(&lrng_node_hashes[node].work,
+			  lrng_pcpu_node_hash_work);
+	}
+
+	/* Ensure the workers are fully initialized before their first use. */
+	mb();
+	lrng_node_hash_avail = true;
+
+	return 0;
+}
+
+late_initcall(lrng_node_hash_init);
+
+#else /* CONFIG_LRNG_NODE_HASH_REDUCTION */
+
+u32 lrng_pcpu_pool_hash(u8 *outbuf, u32 requested_bits, bool fully_seeded)
+{
+	return lrng_pcpu_pool_hash_serial(outbuf, requested_bits,
+					  fully_seeded);
+}
+
+#endif /* CONFIG_LRNG_NODE_HASH_REDUCTION */
+
+#ifdef CONFIG_LRNG_HEALTH_TESTS_BATCH
+
+/* Index of the first collection array slot not yet health-tested */
+static DEFINE_PER_CPU(u32, lrng_pcpu_array_health_ptr) = 0;
+
+/*
+ * Apply the deferred health tests to all collection array slots stored since
+ * the last batch operation and revoke the entropy credit of the stuck time
+ * stamps found in the batch.
+ */
+/* Was the GCD already known when the last batch window was recorded? */
+static DEFINE_PER_CPU(bool, lrng_pcpu_array_health_gcd) = false;
+
+static inline void lrng_pcpu_array_health_test(const u32 *array, u32 ptr)
+{
+	u32 first_idx = this_cpu_read(lrng_pcpu_array_health_ptr);
+	u32 stuck;
+
+	this_cpu_write(lrng_pcpu_array_health_ptr,
+		       (ptr + 1) & LRNG_DATA_WORD_MASK);
+
+	/*
+	 * Until the GCD is known, full 32-bit time stamps are stored in the
+	 * collection array and each time stamp is health-tested when it is
+	 * recorded - there is nothing left for the batch to test.
+	 */
+	if (!lrng_gcd_tested()) {
+		this_cpu_write(lrng_pcpu_array_health_gcd, false);
+		return;
+	}
+
+	/*
+	 * The first batch window after the GCD became known still contains
+	 * full 32-bit time stamps that were recorded and health-tested
+	 * individually before the transition. Skip that window: re-reading
+	 * those words as slots would feed garbage into the stuck and RCT
+	 * tests, insert the samples into the APT a second time and revoke
+	 * entropy credit that was granted legitimately - worst case causing
+	 * a spurious SP800-90B failure at boot.
+	 */
+	if (!this_cpu_read(lrng_pcpu_array_health_gcd)) {
+		this_cpu_write(lrng_pcpu_array_health_gcd, true);
+		return;
+	}
+
+	stuck = lrng_health_test_batch(array, first_idx, ptr);
+	if (stuck) {
+		atomic_t *irqs = this_cpu_ptr(&lrng_pcpu_array_irqs);
+
+		if (atomic_sub_return_relaxed(stuck, irqs) < 0)
+			atomic_set(irqs, 0);
+	}
+}
+
+#else /* CONFIG_LRNG_HEALTH_TESTS_BATCH */
+
+static inline void lrng_pcpu_array_health_test(const u32 *array, u32 ptr) { }
+
+#endif /* CONFIG_LRNG_HEALTH_TESTS_BATCH */
+
+/*************************** LFSR pre-mixing stage ***************************/
+
+#ifdef CONFIG_LRNG_LFSR_PREMIX
+
+/*
+ * Word-wide LFSR pre-mix pool: when the collection array is full, its content
+ * is retained by folding it into this per-CPU pool with a handful of XOR and
+ * rotate operations instead of performing the hash compression in
+ * interrupt-adjacent context. The pool processes one full 32-bit word per
+ * step - the word-wide taps operate as 32 bit-sliced LFSRs in parallel using
+ * only general-purpose registers, as vector registers are unavailable in this
+ * context. The cryptographic conditioning of the pool content is deferred to
+ * the DRNG reseed operation which hashes the pre-mix pool together with the
+ * collection array in process context.
+ *
+ * The polynomial x^32 + x^30 + x^26 + x^25 + 1 is taken from the document
+ * "Table of Linear Feedback Shift Registers" by Roy Ward, Tim Molteno,
+ * October 26, 2007 and is primitive and irreducible which guarantees the
+ * key property of the LFSR providing a compression function for entropy.
+ * The tap values are smaller by one compared to the documentation because
+ * they index an array starting at zero.
+ */
+#define LRNG_LFSR_WORDS		32
+
+struct lrng_lfsr_state {
+	u32 ptr;
+	u32 input_rotate;
+	u32 pool[LRNG_LFSR_WORDS];
+};
+
+static DEFINE_PER_CPU(struct lrng_lfsr_state, lrng_pcpu_lfsr);
+
+static inline void _lrng_lfsr_u32(struct lrng_lfsr_state *lfsr, u32 value)
+{
+	u32 word, ptr;
+
+	/*
+	 * Process the LFSR by altering not adjacent words but rather more
+	 * spaced apart words. Using a prime number ensures that all words
+	 * are processed evenly. As some of the LFSR polynomial taps are close
+	 * together, processing adjacent words with the LFSR taps may be
+	 * inappropriate as the data just mixed-in at these taps may be not
+	 * independent from the current data to be mixed in.
+	 */
+	ptr = (lfsr->ptr + 13) & (LRNG_LFSR_WORDS - 1);
+	lfsr->ptr = ptr;
+
+	/*
+	 * Add 7 bits of rotation to the pool. At the beginning of the pool,
+	 * add an extra 7 bits rotation, so that successive passes spread the
+	 * input bits across the pool evenly.
+	 */
+	lfsr->input_rotate = (lfsr->input_rotate + (ptr ? 7 : 14)) & 31;
+	word = rol32(value, lfsr->input_rotate);
+
+	word ^= lfsr->pool[ptr];
+	word ^= lfsr->pool[(ptr + 31) & (LRNG_LFSR_WORDS - 1)];
+	word ^= lfsr->pool[(ptr + 29) & (LRNG_LFSR_WORDS - 1)];
+	word ^= lfsr->pool[(ptr + 25) & (LRNG_LFSR_WORDS - 1)];
+	word ^= lfsr->pool[(ptr + 24) & (LRNG_LFSR_WORDS - 1)];
+
+	lfsr->pool[ptr] = word;
+}
+
+/* Fold the collection array into the pre-mix pool of the local CPU. */
+static inline void lrng_pcpu_lfsr_fold(const u32 *array)
+{
+	struct lrng_lfsr_state *lfsr = this_cpu_ptr(&lrng_pcpu_lfsr);
+	u32 i;
+
+	for (i = 0; i < LRNG_DATA_ARRAY_SIZE; i++)
+		_lrng_lfsr_u32(lfsr, array[i]);
+}
+
+/*
+ * Condition the pre-mix pool into the per-CPU entropy pool during reseed.
+ * Caller must hold the per-CPU pool lock of @cpu which also guards the
+ * pre-mix pool against a concurrent fold operation.
+ */
+static inline int lrng_pcpu_lfsr_hash(int cpu,
+				      const struct lrng_crypto_cb *crypto_cb,
+				      struct shash_desc *shash)
+{
+	struct lrng_lfsr_state *lfsr = per_cpu_ptr(&lrng_pcpu_lfsr, cpu);
+
+	return crypto_cb->lrng_hash_update(shash, (u8 *)lfsr->pool,
+					   sizeof(lfsr->pool));
+}
+
+#else /* CONFIG_LRNG_LFSR_PREMIX */
+
+static inline void lrng_pcpu_lfsr_fold(const u32 *array) { }
+
+static inline int lrng_pcpu_lfsr_hash(int cpu,
+				      const struct lrng_crypto_cb *crypto_cb,
+				      struct shash_desc *shash)
+{
+	return 0;
+}
+
+#endif /* CONFIG_LRNG_LFSR_PREMIX */
+
+/* Compress the lrng_pcpu_array array into lrng_pcpu_pool */
+static inline void lrng_pcpu_array_compress(void)
+{
+	struct shash_desc *shash =
+			(struct shash_desc *)this_cpu_ptr(lrng_pcpu_pool);
+	struct lrng_drng_hash *hash_state;
+	spinlock_t *lock = this_cpu_ptr(&lrng_pcpu_lock);
+	unsigned long flags;
 
 	if (unlikely(!this_cpu_read(lrng_pcpu_lock_init))) {
-		init = true;
+		struct lrng_drng **lrng_drng = lrng_drng_instances();
+		struct lrng_drng *drng = lrng_drng_init_instance();
+		int node = lrng_drng_curr_instance();
+		bool init_ok;
+
+		/* Get instance-local hash - NUMA-node or CPU local */
+		if (lrng_drng && lrng_drng[node])
+			drng = lrng_drng[node];
+
 		spin_lock_init(lock);
-		this_cpu_write(lrng_pcpu_lock_init, true);
+
+		/*
+		 * Register the pool with the instance-wide hash reference.
+		 * The registration lock guarantees that the reference cannot
+		 * be retired while the pool state is set up and that the pool
+		 * is either converted by a concurrent switch operation or
+		 * already starts out with the new reference. As the pool is
+		 * not marked online yet, no other CPU operates on its state.
+		 */
+		spin_lock_irqsave(&lrng_pcpu_hash_switch_lock, flags);
+		hash_state = rcu_dereference_check(drng->hash_state,
+				lockdep_is_held(&lrng_pcpu_hash_switch_lock));
+		this_cpu_write(lrng_pcpu_hash_state, hash_state);
+		init_ok = !hash_state->crypto_cb->lrng_hash_init(
+						shash, hash_state->hash);
+		if (init_ok)
+			this_cpu_write(lrng_pcpu_lock_init, true);
+		spin_unlock_irqrestore(&lrng_pcpu_hash_switch_lock, flags);
+
+		if (!init_ok) {
+			pr_warn("Initialization of hash failed\n");
+			return;
+		}
+
 		pr_debug("Initializing per-CPU entropy pool for CPU %d on NUMA node %d with hash %s\n",
 			 raw_smp_processor_id(), node,
-			 crypto_cb->lrng_hash_name());
+			 hash_state->crypto_cb->lrng_hash_name());
 	}
 
-	spin_lock_irqsave(lock, flags2);
-
-	if (unlikely(init) && crypto_cb->lrng_hash_init(shash, hash)) {
-		this_cpu_write(lrng_pcpu_lock_init, false);
-		pr_warn("Initialization of hash failed\n");
-	} else if (lrng_pcpu_continuous_compression) {
-		/* Add entire per-CPU data array content into entropy pool. */
-		if (crypto_cb->lrng_hash_update(shash,
-					(u8 *)this_cpu_ptr(lrng_pcpu_array),
-					LRNG_DATA_ARRAY_SIZE * sizeof(u32)))
-			pr_warn_ratelimited("Hashing of entropy data failed\n");
+	/*
+	 * With the LFSR pre-mixing stage, the array content is retained with
+	 * a few XOR and rotate operations and the hash compression is
+	 * deferred to the reseed operation - this supersedes the continuous
+	 * compression setting.
+	 */
+	if (IS_ENABLED(CONFIG_LRNG_LFSR_PREMIX)) {
+		spin_lock_irqsave(lock, flags);
+		lrng_pcpu_lfsr_fold(this_cpu_ptr(lrng_pcpu_array));
+		spin_unlock_irqrestore(lock, flags);
+		return;
 	}
 
-	spin_unlock_irqrestore(lock, flags2);
-	lrng_hash_unlock(drng, flags);
+	if (!lrng_pcpu_continuous_compression)
+		return;
+
+	spin_lock_irqsave(lock, flags);
+
+	hash_state = this_cpu_read(lrng_pcpu_hash_state);
+
+	/* Add entire per-CPU data array content into entropy pool. */
+	if (hash_state->crypto_cb->lrng_hash_update(shash,
+				(u8 *)this_cpu_ptr(lrng_pcpu_array),
+				LRNG_DATA_ARRAY_SIZE * sizeof(u32)))
+		pr_warn_ratelimited("Hashing of entropy data failed\n");
+
+	spin_unlock_irqrestore(lock, flags);
 }
 
 /* Compress data array into hash */
@@ -637,12 +1168,44 @@ static inline void lrng_pcpu_array_to_hash(u32 ptr)
 		for (i = 1; i < LRNG_DATA_ARRAY_SIZE; i++)
 			lrng_raw_array_entropy_store(*(array + i));
 	} else {
+		u32 perf = lrng_perf_stage_start();
+
+		lrng_pcpu_array_health_test(array, ptr);
+		lrng_perf_stage_time(lrng_perf_stage_health, perf);
+
+		perf = lrng_perf_stage_start();
 		lrng_pcpu_array_compress();
+		lrng_perf_stage_time(lrng_perf_stage_compress, perf);
+
 		/* Ping pool handler about received entropy */
 		lrng_pool_add_entropy();
 	}
 }
 
+#ifdef CONFIG_LRNG_COLLECTION_WIDE_SLOTS
+
+/* With one time stamp per array word, the insert is a single indexed store. */
+static inline void lrng_pcpu_array_add_wide(u32 data)
+{
+	u32 perf = lrng_perf_stage_start();
+	u32 ptr = this_cpu_inc_return(lrng_pcpu_array_ptr) &
+							LRNG_DATA_WORD_MASK;
+
+	BUILD_BUG_ON(LRNG_DATA_SLOTS_PER_UINT != 1);
+
+	this_cpu_write(lrng_pcpu_array[ptr], data);
+	lrng_perf_stage_time(lrng_perf_stage_insert, perf);
+
+	lrng_pcpu_array_to_hash(ptr);
+}
+
+static inline void _lrng_pcpu_array_add_u32(u32 data)
+{
+	lrng_pcpu_array_add_wide(data);
+}
+
+#else /* CONFIG_LRNG_COLLECTION_WIDE_SLOTS */
+
 /*
  * Concatenate full 32 bit word at the end of time array even when current
  * ptr is not aligned to sizeof(data).
@@ -687,6 +1250,8 @@ static inline void _lrng_pcpu_array_add_u32(u32 data)
 		lrng_pcpu_array_to_hash(ptr);
 }
 
+#endif /* CONFIG_LRNG_COLLECTION_WIDE_SLOTS */
+
 /* Concatenate a 32-bit word at the end of the per-CPU array */
 void lrng_pcpu_array_add_u32(u32 data)
 {
@@ -701,6 +1266,10 @@ void lrng_pcpu_array_add_u32(u32 data)
 /* Concatenate data of max LRNG_DATA_SLOTSIZE_MASK at the end of time array */
 static inline void lrng_pcpu_array_add_slot(u32 data)
 {
+#ifdef CONFIG_LRNG_COLLECTION_WIDE_SLOTS
+	lrng_pcpu_array_add_wide(data);
+#else
+	u32 perf = lrng_perf_stage_start();
 	/* Get slot */
 	u32 ptr = this_cpu_inc_return(lrng_pcpu_array_ptr) &
 							LRNG_DATA_WORD_MASK;
@@ -718,19 +1287,35 @@ static inline void lrng_pcpu_array_add_slot(u32 data)
 					  slot)));
 	/* Store data into slot */
 	this_cpu_or(lrng_pcpu_array[array], lrng_data_slot_val(data, slot));
+	lrng_perf_stage_time(lrng_perf_stage_insert, perf);
 
 	lrng_pcpu_array_to_hash(ptr);
+#endif /* CONFIG_LRNG_COLLECTION_WIDE_SLOTS */
 }
 
 static inline void
-lrng_time_process_common(u32 time, void(*add_time)(u32 data))
+lrng_time_process_common(u32 time, void(*add_time)(u32 data), bool defer)
 {
 	enum lrng_health_res health_test;
+	u32 perf;
 
 	if (lrng_raw_hires_entropy_store(time))
 		return;
 
+	if (IS_ENABLED(CONFIG_LRNG_HEALTH_TESTS_BATCH) && defer) {
+		/*
+		 * The health test is deferred into the batch operation of
+		 * lrng_pcpu_array_to_hash - credit the event now and revoke
+		 * the credit in case the batch flags the time stamp as stuck.
+		 */
+		atomic_inc_return(this_cpu_ptr(&lrng_pcpu_array_irqs));
+		add_time(time);
+		return;
+	}
+
+	perf = lrng_perf_stage_start();
 	health_test = lrng_health_test(time);
+	lrng_perf_stage_time(lrng_perf_stage_health, perf);
 	if (health_test > lrng_health_fail_use)
 		return;
 
@@ -749,13 +1334,25 @@ static inline void lrng_time_process(void)
 
 	if (unlikely(!lrng_gcd_tested())) {
 		/* When GCD is unknown, we process the full time stamp */
-		lrng_time_process_common(now_time, _lrng_pcpu_array_add_u32);
+		lrng_time_process_common(now_time, _lrng_pcpu_array_add_u32,
+					 false);
 		lrng_gcd_add_value(now_time);
 	} else {
-		/* GCD is known and applied */
-		lrng_time_process_common((now_time / lrng_gcd_timer) &
+		/* GCD is known and its power-of-two component is applied */
+		lrng_time_process_common((now_time >> lrng_gcd_shift) &
 					 LRNG_DATA_SLOTSIZE_MASK,
-					 lrng_pcpu_array_add_slot);
+					 lrng_pcpu_array_add_slot, true);
+
+		/*
+		 * Sample time stamps at a low per-CPU rate to recalibrate the
+		 * GCD during runtime - timer granularity may change after the
+		 * boot-time analysis, e.g. with frequency scaling.
+		 */
+		if (unlikely(this_cpu_inc_return(lrng_gcd_sample_cnt) >=
+			     LRNG_GCD_RECAL_INTERVAL)) {
+			this_cpu_write(lrng_gcd_sample_cnt, 0);
+			lrng_gcd_add_value(now_time);
+		}
 	}
 
 	lrng_perf_time(now_time);
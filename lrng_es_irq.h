@@ -11,13 +11,35 @@
  * injects them into the entropy pool when the array is full.
  */
 
+#ifdef CONFIG_LRNG_COLLECTION_WIDE_SLOTS
+/* Store one full time stamp per u32 array word */
+#define LRNG_DATA_SLOTSIZE_BITS		(32)
+#define LRNG_DATA_SLOTSIZE_MASK		(0xffffffffU)
+#else
 /* Store multiple integers in one u32 */
 #define LRNG_DATA_SLOTSIZE_BITS		(8)
 #define LRNG_DATA_SLOTSIZE_MASK		((1 << LRNG_DATA_SLOTSIZE_BITS) - 1)
+#endif
 #define LRNG_DATA_ARRAY_MEMBER_BITS	(4 << 3) /* ((sizeof(u32)) << 3) */
 #define LRNG_DATA_SLOTS_PER_UINT	(LRNG_DATA_ARRAY_MEMBER_BITS / \
 					 LRNG_DATA_SLOTSIZE_BITS)
 
+/*
+ * Low time stamp bits tested for the presence of a high-resolution timer -
+ * the detection criterion is independent of the configured slot width.
+ */
+#define LRNG_DATA_HIGHRES_MASK		((1 << 8) - 1)
+
+/*
+ * Alignment of the per-CPU collection array - with full-width slots, align
+ * the array to the cache line size as every interrupt writes a full word.
+ */
+#ifdef CONFIG_LRNG_COLLECTION_WIDE_SLOTS
+#define LRNG_DATA_ARRAY_ALIGN		L1_CACHE_BYTES
+#else
+#define LRNG_DATA_ARRAY_ALIGN		LRNG_KCAPI_ALIGN
+#endif
+
 /*
  * Number of time values to store in the array - in small environments
  * only one atomic_t variable per CPU is used.
@@ -7,7 +7,10 @@
 
 #define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
 
+#include <linux/kthread.h>
+#include <linux/sched.h>
 #include <linux/types.h>
+#include <linux/wait.h>
 #include <crypto/internal/jitterentropy.h>
 
 #include "lrng_internal.h"
@@ -27,6 +30,129 @@ MODULE_PARM_DESC(jitterrng, "Entropy in bits of 256 data bits from Jitter RNG no
 
 static bool lrng_jent_initialized = false;
 static struct rand_data *lrng_jent_state;
+static DEFINE_SPINLOCK(lrng_jent_lock);
+
+#ifdef CONFIG_LRNG_JENT_ASYNC
+
+/* Number of pre-generated Jitter RNG blocks held in the ring buffer */
+#define LRNG_JENT_ASYNC_BLOCKS	4
+
+/* Backoff of the generator thread when the Jitter RNG reports a failure */
+#define LRNG_JENT_ASYNC_BACKOFF	HZ
+
+/*
+ * Ring buffer of pre-generated Jitter RNG blocks: the generator thread
+ * fills the ring in the background such that the seeding operation is
+ * served with a copy operation instead of the synchronous generation of a
+ * block. Each block is sized for the largest possible seed buffer slice
+ * and passed the health tests of the Jitter RNG at generation time.
+ */
+struct lrng_jent_block {
+	u8 data[LRNG_DRNG_INIT_SEED_SIZE_BYTES] __aligned(LRNG_KCAPI_ALIGN);
+};
+
+static struct lrng_jent_block lrng_jent_ring[LRNG_JENT_ASYNC_BLOCKS];
+static u32 lrng_jent_ring_reader;
+static u32 lrng_jent_ring_writer;
+static DEFINE_SPINLOCK(lrng_jent_ring_lock);
+static DECLARE_WAIT_QUEUE_HEAD(lrng_jent_ring_wait);
+
+static bool lrng_jent_ring_full(void)
+{
+	return (lrng_jent_ring_writer - lrng_jent_ring_reader) >=
+	       LRNG_JENT_ASYNC_BLOCKS;
+}
+
+/*
+ * Serve the request from the ring buffer. As a block is consumed entirely,
+ * the generator thread is woken up to replenish the ring.
+ *
+ * Return: amount of data in bytes copied to outbuf
+ */
+static u32 lrng_jent_async_pull(u8 *outbuf, u32 requested_bytes)
+{
+	struct lrng_jent_block *block;
+	unsigned long flags;
+
+	if (requested_bytes > sizeof(block->data))
+		return 0;
+
+	spin_lock_irqsave(&lrng_jent_ring_lock, flags);
+	if (lrng_jent_ring_reader == lrng_jent_ring_writer) {
+		spin_unlock_irqrestore(&lrng_jent_ring_lock, flags);
+		return 0;
+	}
+
+	block = &lrng_jent_ring[lrng_jent_ring_reader %
+				LRNG_JENT_ASYNC_BLOCKS];
+	memcpy(outbuf, block->data, requested_bytes);
+	memzero_explicit(block->data, sizeof(block->data));
+	lrng_jent_ring_reader++;
+	spin_unlock_irqrestore(&lrng_jent_ring_lock, flags);
+
+	wake_up_interruptible(&lrng_jent_ring_wait);
+
+	return requested_bytes;
+}
+
+static int lrng_jent_async_thread(void *unused)
+{
+	while (!kthread_should_stop()) {
+		u8 tmp[LRNG_DRNG_INIT_SEED_SIZE_BYTES]
+						__aligned(LRNG_KCAPI_ALIGN);
+		unsigned long flags;
+		int ret;
+
+		wait_event_interruptible(lrng_jent_ring_wait,
+					 !lrng_jent_ring_full() ||
+					 kthread_should_stop());
+		if (kthread_should_stop())
+			break;
+
+		spin_lock_irqsave(&lrng_jent_lock, flags);
+		ret = jent_read_entropy(lrng_jent_state, tmp, sizeof(tmp));
+		spin_unlock_irqrestore(&lrng_jent_lock, flags);
+		if (ret) {
+			pr_debug("Jitter RNG failed with %d\n", ret);
+			schedule_timeout_interruptible(LRNG_JENT_ASYNC_BACKOFF);
+			continue;
+		}
+
+		spin_lock_irqsave(&lrng_jent_ring_lock, flags);
+		if (!lrng_jent_ring_full()) {
+			memcpy(lrng_jent_ring[lrng_jent_ring_writer %
+					      LRNG_JENT_ASYNC_BLOCKS].data,
+			       tmp, sizeof(tmp));
+			lrng_jent_ring_writer++;
+		}
+		spin_unlock_irqrestore(&lrng_jent_ring_lock, flags);
+
+		memzero_explicit(tmp, sizeof(tmp));
+	}
+
+	return 0;
+}
+
+static void lrng_jent_async_init(void)
+{
+	struct task_struct *thread;
+
+	thread = kthread_run(lrng_jent_async_thread, NULL, "lrng_jent");
+	if (IS_ERR(thread))
+		pr_warn("cannot start Jitter RNG generator thread (%ld)\n",
+			PTR_ERR(thread));
+}
+
+#else /* CONFIG_LRNG_JENT_ASYNC */
+
+static inline u32 lrng_jent_async_pull(u8 *outbuf, u32 requested_bytes)
+{
+	return 0;
+}
+
+static inline void lrng_jent_async_init(void) { }
+
+#endif /* CONFIG_LRNG_JENT_ASYNC */
 
 static int __init lrng_jent_initialize(void)
 {
@@ -38,6 +164,7 @@ static int __init lrng_jent_initialize(void)
 		return 0;
 	}
 	lrng_jent_initialized = true;
+	lrng_jent_async_init();
 	lrng_pool_add_entropy();
 	pr_debug("Jitter RNG working on current system\n");
 
@@ -60,7 +187,13 @@ u32 lrng_get_jent(u8 *outbuf, u32 requested_bits)
 	int ret;
 	u32 ent_bits = lrng_jent_entropylevel(requested_bits);
 	unsigned long flags;
-	static DEFINE_SPINLOCK(lrng_jent_lock);
+
+	/* Non-blocking pull of a pre-generated and health-tested block. */
+	if (lrng_jent_async_pull(outbuf, requested_bits >> 3)) {
+		pr_debug("obtained %u bits of pre-generated entropy from Jitter RNG noise source\n",
+			 ent_bits);
+		return ent_bits;
+	}
 
 	spin_lock_irqsave(&lrng_jent_lock, flags);
 
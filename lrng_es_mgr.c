@@ -163,8 +163,10 @@ void lrng_unset_fully_seeded(struct lrng_drng *drng)
 /* Policy to enable LRNG operational mode */
 static inline void lrng_set_operational(u32 external_es)
 {
-	/* LRNG is operational if the initial DRNG is fully seeded ... */
-	if (lrng_state.lrng_fully_seeded &&
+	/* LRNG is operational if the power-up self tests completed ... */
+	if (lrng_selftest_completed() &&
+	    /* ... and the initial DRNG is fully seeded ... */
+	    lrng_state.lrng_fully_seeded &&
 	    /* ... and either internal ES SP800-90B startup is complete ... */
 	    (lrng_sp80090b_startup_complete() ||
 	    /* ... or the external ES provided sufficient entropy. */
@@ -298,6 +300,15 @@ int __init rand_initialize(void)
 /* Interface requesting a reseed of the DRNG */
 void lrng_pool_add_entropy(void)
 {
+	/*
+	 * The statistics cache is deliberately not updated here: this path
+	 * runs from interrupt context for every collection array fill and
+	 * for every aux pool insertion, while the cache walks all online
+	 * CPUs. The readers lazily refresh the cache when it is older than
+	 * LRNG_STATS_MAX_AGE which bounds its staleness to the monitoring
+	 * poll interval without any hot-path cost.
+	 */
+
 	/*
 	 * Once all DRNGs are fully seeded, the interrupt noise
 	 * sources will not trigger any reseeding any more.
@@ -325,6 +336,99 @@ void lrng_pool_add_entropy(void)
 		lrng_drng_seed_work(NULL);
 }
 
+#ifdef CONFIG_LRNG_PARALLEL_COLLECTION
+
+/*
+ * Shared state of one collection round - the workers fill their slice of the
+ * seed buffer referenced here. Serialized by lrng_seed_collect_lock.
+ */
+static struct entropy_buf *lrng_seed_collect_eb;
+static u32 lrng_seed_collect_bits;
+static bool lrng_seed_collect_avail __read_mostly = false;
+static DEFINE_MUTEX(lrng_seed_collect_lock);
+
+static void lrng_seed_collect_arch(struct work_struct *work)
+{
+	struct entropy_buf *eb = lrng_seed_collect_eb;
+
+	eb->c_bits = lrng_get_arch(eb->c, lrng_seed_collect_bits);
+}
+
+static void lrng_seed_collect_jent(struct work_struct *work)
+{
+	struct entropy_buf *eb = lrng_seed_collect_eb;
+
+	eb->d_bits = lrng_get_jent(eb->d, lrng_seed_collect_bits);
+}
+
+static DECLARE_WORK(lrng_seed_collect_arch_work, lrng_seed_collect_arch);
+static DECLARE_WORK(lrng_seed_collect_jent_work, lrng_seed_collect_jent);
+
+/*
+ * Query the independent entropy sources concurrently: the CPU and Jitter RNG
+ * entropy sources are dispatched to workers while the per-CPU entropy pools
+ * are hashed by the calling CPU. The collection completes when all sources
+ * delivered their data which bounds the collection duration by the slowest
+ * entropy source instead of the sum of all sources.
+ *
+ * The auxiliary pool is deliberately not part of the fan-out: its processing
+ * in lrng_get_backtrack_aux mixes the complete seed buffer back into the pool
+ * for backtracking resistance and thus must observe the final data of all
+ * other slices.
+ *
+ * Return: true if the seed buffer was filled, false if the caller must fall
+ * back to the serial collection.
+ */
+static bool lrng_fill_seed_buffer_parallel(struct entropy_buf *entropy_buf,
+					   u32 requested_bits,
+					   bool fully_seeded)
+{
+	/* During early boot the workqueues are not yet operational. */
+	if (!lrng_seed_collect_avail)
+		return false;
+
+	/* Concurrent collections share the worker state - serialize them. */
+	mutex_lock(&lrng_seed_collect_lock);
+
+	lrng_seed_collect_eb = entropy_buf;
+	lrng_seed_collect_bits = requested_bits;
+	schedule_work(&lrng_seed_collect_arch_work);
+	schedule_work(&lrng_seed_collect_jent_work);
+
+	entropy_buf->b_bits = lrng_pcpu_pool_hash(entropy_buf->b,
+						  requested_bits,
+						  fully_seeded);
+
+	flush_work(&lrng_seed_collect_arch_work);
+	flush_work(&lrng_seed_collect_jent_work);
+	lrng_seed_collect_eb = NULL;
+
+	mutex_unlock(&lrng_seed_collect_lock);
+	return true;
+}
+
+static int __init lrng_seed_collect_init(void)
+{
+	/* Ensure the worker state is fully visible before its first use. */
+	mb();
+	lrng_seed_collect_avail = true;
+
+	return 0;
+}
+
+late_initcall(lrng_seed_collect_init);
+
+#else /* CONFIG_LRNG_PARALLEL_COLLECTION */
+
+static bool lrng_fill_seed_buffer_parallel(struct entropy_buf *entropy_buf,
+					   u32 requested_bits,
+					   bool fully_seeded)
+{
+	return false;
+}
+
+#endif /* CONFIG_LRNG_PARALLEL_COLLECTION */
+
 /* Fill the seed buffer with data from the noise sources */
 void lrng_fill_seed_buffer(struct entropy_buf *entropy_buf, u32 requested_bits)
 {
@@ -350,17 +454,25 @@ void lrng_fill_seed_buffer(struct entropy_buf *entropy_buf, u32 requested_bits)
 	}
 
 	/* Concatenate the output of the entropy sources. */
-	entropy_buf->b_bits = lrng_pcpu_pool_hash(entropy_buf->b,
-						  requested_bits,
-						  state->lrng_fully_seeded);
-	entropy_buf->c_bits = lrng_get_arch(entropy_buf->c, requested_bits);
-	entropy_buf->d_bits = lrng_get_jent(entropy_buf->d, requested_bits);
+	if (!lrng_fill_seed_buffer_parallel(entropy_buf, requested_bits,
+					    state->lrng_fully_seeded)) {
+		entropy_buf->b_bits = lrng_pcpu_pool_hash(
+						entropy_buf->b, requested_bits,
+						state->lrng_fully_seeded);
+		entropy_buf->c_bits = lrng_get_arch(entropy_buf->c,
+						    requested_bits);
+		entropy_buf->d_bits = lrng_get_jent(entropy_buf->d,
+						    requested_bits);
+	}
 	lrng_get_backtrack_aux(entropy_buf, requested_bits);
 
 	/* allow external entropy provider to provide seed */
 	lrng_state_exseed_allow_all();
 
 wakeup:
+	/* The collection changed the per-ES entropy levels. */
+	lrng_stats_update();
+
 	/*
 	 * Shall we wake up user space writers? This location covers
 	 * ensures that the user space provider does not dominate the internal
@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: GPL-2.0 OR BSD-2-Clause
+/*
+ * Backend for the LRNG providing the entropy pool hash through the kernel
+ * crypto API while retaining the ChaCha20 DRNG.
+ *
+ * The kernel crypto API instantiates the highest-priority SHA-256
+ * implementation available on the system. With the arch-optimized drivers
+ * enabled (e.g. SHA-NI on x86 or the ARMv8 Crypto Extensions), the per-CPU
+ * entropy pool compression executing in interrupt context is dispatched to
+ * the hardware-accelerated implementation. The arch drivers transparently
+ * fall back to the C implementation when the SIMD unit is unusable in the
+ * current context which makes the hash usable from the atomic code paths.
+ *
+ * Copyright (C) 2021, Stephan Mueller <smueller@chronox.de>
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <crypto/hash.h>
+#include <linux/init.h>
+#include <linux/lrng.h>
+#include <linux/module.h>
+
+#include "lrng_internal.h"
+#include "lrng_kcapi_hash.h"
+
+static const char *lrng_hash_arch_name = "sha256";
+
+/*
+ * The DRNG callbacks are forwarded to the ChaCha20 DRNG implementation as
+ * only the hash primitive shall be replaced. This retains the property that
+ * the DRNG is usable in atomic contexts.
+ */
+static int lrng_hash_arch_drng_seed_helper(void *drng, const u8 *inbuf,
+					   u32 inbuflen)
+{
+	return lrng_cc20_crypto_cb.lrng_drng_seed_helper(drng, inbuf,
+							 inbuflen);
+}
+
+static int lrng_hash_arch_drng_generate_helper(void *drng, u8 *outbuf,
+					       u32 outbuflen)
+{
+	return lrng_cc20_crypto_cb.lrng_drng_generate_helper(drng, outbuf,
+							     outbuflen);
+}
+
+static void *lrng_hash_arch_drng_alloc(u32 sec_strength)
+{
+	return lrng_cc20_crypto_cb.lrng_drng_alloc(sec_strength);
+}
+
+static void lrng_hash_arch_drng_dealloc(void *drng)
+{
+	lrng_cc20_crypto_cb.lrng_drng_dealloc(drng);
+}
+
+static const char *lrng_hash_arch_drng_name(void)
+{
+	return lrng_cc20_crypto_cb.lrng_drng_name();
+}
+
+static void *lrng_hash_arch_hash_alloc(void)
+{
+	return lrng_kcapi_hash_alloc(lrng_hash_arch_name);
+}
+
+static const char *lrng_hash_arch_hash_name(void)
+{
+	return lrng_hash_arch_name;
+}
+
+static const struct lrng_crypto_cb lrng_hash_arch_crypto_cb = {
+	.lrng_drng_name			= lrng_hash_arch_drng_name,
+	.lrng_hash_name			= lrng_hash_arch_hash_name,
+	.lrng_drng_alloc		= lrng_hash_arch_drng_alloc,
+	.lrng_drng_dealloc		= lrng_hash_arch_drng_dealloc,
+	.lrng_drng_seed_helper		= lrng_hash_arch_drng_seed_helper,
+	.lrng_drng_generate_helper	= lrng_hash_arch_drng_generate_helper,
+	.lrng_hash_alloc		= lrng_hash_arch_hash_alloc,
+	.lrng_hash_dealloc		= lrng_kcapi_hash_dealloc,
+	.lrng_hash_digestsize		= lrng_kcapi_hash_digestsize,
+	.lrng_hash_init			= lrng_kcapi_hash_init,
+	.lrng_hash_update		= lrng_kcapi_hash_update,
+	.lrng_hash_final		= lrng_kcapi_hash_final,
+	.lrng_hash_desc_zero		= lrng_kcapi_hash_zero,
+};
+
+static int __init lrng_hash_arch_init(void)
+{
+	return lrng_set_drng_cb(&lrng_hash_arch_crypto_cb);
+}
+
+late_initcall(lrng_hash_arch_init);
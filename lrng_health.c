@@ -7,10 +7,14 @@
 
 #define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
 
+#include <linux/bitops.h>
 #include <linux/fips.h>
 #include <linux/module.h>
 
 #include "lrng_internal.h"
+#ifdef CONFIG_LRNG_HEALTH_TESTS_BATCH
+#include "lrng_es_irq.h"
+#endif
 
 /* Stuck Test */
 struct lrng_stuck_test {
@@ -408,3 +412,196 @@ enum lrng_health_res lrng_health_test(u32 now_time)
 
 	return lrng_health_pass;
 }
+
+#ifdef CONFIG_LRNG_HEALTH_TESTS_BATCH
+
+/* Read the time stamp slot stored for the given index */
+static inline u32 lrng_data_slot_read(const u32 *array, u32 idx)
+{
+	return (array[lrng_data_idx2array(idx)] >>
+		lrng_data_slot2bitindex(lrng_data_idx2slot(idx))) &
+	       LRNG_DATA_SLOTSIZE_MASK;
+}
+
+#ifdef CONFIG_LRNG_COLLECTION_WIDE_SLOTS
+
+/* With one time stamp per word, no broadcast replication is needed. */
+#define LRNG_APT_SWAR_ONES	0x00000001U
+
+/* Compare the single time stamp of one collection array word directly. */
+static inline u32 lrng_apt_word_matches(u32 word, u32 base_bcast)
+{
+	return (word & LRNG_APT_WORD_MASK) == base_bcast;
+}
+
+#else /* CONFIG_LRNG_COLLECTION_WIDE_SLOTS */
+
+/* SWAR constants replicating one value into each slot of a u32 word */
+#define LRNG_APT_SWAR_ONES	0x01010101U
+#define LRNG_APT_SWAR_LOW	0x7f7f7f7fU
+
+/*
+ * Count the slots of one collection array word matching the APT base.
+ *
+ * The slots are compared word-parallel: the APT-relevant LSBs of all slots
+ * are XORed with the broadcast base value, matching slots become zero and
+ * the zero slots are flagged carry-less and counted with the population
+ * count. This processes LRNG_DATA_SLOTS_PER_UINT time stamps with a handful
+ * of ALU operations instead of a shift/mask/compare cascade per slot.
+ */
+static inline u32 lrng_apt_word_matches(u32 word, u32 base_bcast)
+{
+	u32 x = (word & (LRNG_APT_WORD_MASK * LRNG_APT_SWAR_ONES)) ^ base_bcast;
+	u32 zero = ~((((x & LRNG_APT_SWAR_LOW) + LRNG_APT_SWAR_LOW) | x) |
+		     LRNG_APT_SWAR_LOW);
+
+	return hweight32(zero);
+}
+
+#endif /* CONFIG_LRNG_COLLECTION_WIDE_SLOTS */
+
+/*
+ * Insert a batch of time stamps resting in the collection array into the APT
+ *
+ * The batch is processed in chunks bounded by the remaining size of the
+ * current APT window such that all slots of a chunk are compared against
+ * the same base value. Aligned full words of a chunk are compared
+ * word-parallel with lrng_apt_word_matches(). The APT counter and window
+ * trigger are updated once per chunk instead of once per time stamp.
+ *
+ * An APT failure is detected at the end of the chunk containing the
+ * offending time stamps - as the failure handling applies to the entire
+ * LRNG state and the chunk caller revokes the entropy credit, the deferred
+ * detection point is equivalent to the per-sample detection.
+ */
+static void lrng_apt_insert_batch(struct lrng_health *health,
+				  const u32 *array, u32 first_idx,
+				  u32 last_idx)
+{
+	struct lrng_apt *apt = &health->apt;
+	u32 idx = first_idx;
+	u32 nsamples = ((last_idx - first_idx) & LRNG_DATA_WORD_MASK) + 1;
+
+	/* The broadcast comparison requires one slot per byte. */
+	BUILD_BUG_ON(LRNG_DATA_SLOTSIZE_BITS != 8 &&
+		     LRNG_DATA_SLOTS_PER_UINT != 1);
+
+	if (!lrng_sp80090b_health_requested())
+		return;
+
+	/* Initialization of APT */
+	if (!apt->apt_base_set) {
+		atomic_set(&apt->apt_base,
+			   lrng_data_slot_read(array, idx) &
+			   LRNG_APT_WORD_MASK);
+		apt->apt_base_set = true;
+		idx = (idx + 1) & LRNG_DATA_WORD_MASK;
+		nsamples--;
+	}
+
+	while (nsamples) {
+		u32 trigger = (u32)atomic_read(&apt->apt_trigger);
+		u32 chunk = min_t(u32, nsamples, trigger ? trigger : 1);
+		u32 base_bcast = ((u32)atomic_read(&apt->apt_base)) *
+				 LRNG_APT_SWAR_ONES;
+		u32 done = 0, matches = 0;
+
+		while (done < chunk) {
+			if (!lrng_data_idx2slot(idx) &&
+			    (chunk - done) >= LRNG_DATA_SLOTS_PER_UINT) {
+				matches += lrng_apt_word_matches(
+						array[lrng_data_idx2array(idx)],
+						base_bcast);
+				idx = (idx + LRNG_DATA_SLOTS_PER_UINT) &
+				      LRNG_DATA_WORD_MASK;
+				done += LRNG_DATA_SLOTS_PER_UINT;
+			} else {
+				u32 sample = lrng_data_slot_read(array, idx) &
+					     LRNG_APT_WORD_MASK;
+
+				matches += (sample == (base_bcast &
+						       LRNG_APT_WORD_MASK));
+				idx = (idx + 1) & LRNG_DATA_WORD_MASK;
+				done++;
+			}
+		}
+
+		nsamples -= chunk;
+
+		if (matches) {
+			u32 apt_val =
+				(u32)atomic_add_return_relaxed(matches,
+							       &apt->apt_count);
+
+			if (apt_val >= CONFIG_LRNG_APT_CUTOFF)
+				lrng_sp80090b_failure(health);
+		}
+
+		/*
+		 * Unlike the per-sample atomic_dec_and_test, the chunked
+		 * decrement may skip the exact zero crossing when racing with
+		 * insertions of other CPUs - thus treat any non-positive
+		 * trigger value as the end of the window. The last time stamp
+		 * of the window becomes the new base.
+		 */
+		if (atomic_sub_return(chunk, &apt->apt_trigger) <= 0) {
+			lrng_apt_restart(health);
+			lrng_apt_reset(health,
+				       lrng_data_slot_read(array,
+						(idx - 1) &
+						LRNG_DATA_WORD_MASK) &
+				       LRNG_APT_WORD_MASK);
+			lrng_sp80090b_startup(health);
+		}
+	}
+}
+
+/*
+ * Perform health tests on a batch of time stamps resting in the per-CPU
+ * collection array
+ *
+ * The tests are identical to the tests applied by lrng_health_test for an
+ * individual time stamp. The batch operation processes all time stamp slots
+ * stored since the last batch in one go when the collection array content is
+ * inserted into the per-CPU entropy pool instead of testing each time stamp
+ * in the interrupt handler that recorded it.
+ *
+ * The function must execute on the CPU owning the collection array as it
+ * operates on the per-CPU stuck test state.
+ *
+ * @array [in] Collection array holding the time stamp slots
+ * @first_idx [in] Index of first slot to process
+ * @last_idx [in] Index of last slot to process - the processing wraps around
+ *		  the end of the collection array if last_idx < first_idx
+ * @return: number of stuck time stamps found in the batch whose entropy
+ *	    credit the caller must revoke
+ */
+u32 lrng_health_test_batch(const u32 *array, u32 first_idx, u32 last_idx)
+{
+	struct lrng_health *health = &lrng_health;
+	struct lrng_stuck_test *stuck_test = this_cpu_ptr(&lrng_stuck_test);
+	u32 idx = first_idx, stuck_vals = 0;
+
+	if (!health->health_test_enabled)
+		return 0;
+
+	lrng_apt_insert_batch(health, array, first_idx, last_idx);
+
+	for (;;) {
+		u32 sample = lrng_data_slot_read(array, idx);
+		int stuck;
+
+		stuck = lrng_irq_stuck(stuck_test, sample);
+		lrng_rct(health, stuck);
+		if (stuck)
+			stuck_vals++;
+
+		if (idx == last_idx)
+			break;
+		idx = (idx + 1) & LRNG_DATA_WORD_MASK;
+	}
+
+	return stuck_vals;
+}
+
+#endif /* CONFIG_LRNG_HEALTH_TESTS_BATCH */
@@ -10,14 +10,18 @@
 #include <linux/freezer.h>
 #include <linux/fs.h>
 #include <linux/genhd.h>
+#include <linux/highmem.h>
 #include <linux/hw_random.h>
 #include <linux/kthread.h>
+#include <linux/llist.h>
+#include <linux/mm.h>
 #include <linux/poll.h>
 #include <linux/preempt.h>
 #include <linux/random.h>
 #include <linux/slab.h>
 #include <linux/syscalls.h>
 #include <linux/timex.h>
+#include <linux/uio.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/random.h>
@@ -31,8 +35,20 @@
  */
 u32 lrng_write_wakeup_bits = (LRNG_WRITE_WAKEUP_ENTROPY << 3);
 
-static LIST_HEAD(lrng_ready_list);
-static DEFINE_SPINLOCK(lrng_ready_list_lock);
+/*
+ * Lock-free list of readiness callbacks: registration pushes the callback
+ * with one cmpxchg, the processing side drains the entire list atomically.
+ * The llist link is stored in the next pointer of the list_head embedded
+ * in struct random_ready_callback; the otherwise unused prev pointer holds
+ * the node state driving the race-free cancellation protocol.
+ */
+static LLIST_HEAD(lrng_ready_list);
+
+/* Node states stored in the prev pointer of the embedded list_head */
+#define LRNG_READY_QUEUED	((void *)0x1)	/* Linked into the list */
+#define LRNG_READY_CANCEL	((void *)0x2)	/* Deletion requested */
+#define LRNG_READY_RUNNING	((void *)0x3)	/* Callback executing */
+#define LRNG_READY_GONE		((void *)0x4)	/* Unlinked, memory unused */
 
 static DECLARE_WAIT_QUEUE_HEAD(lrng_write_wait);
 static DECLARE_WAIT_QUEUE_HEAD(lrng_init_wait);
@@ -46,17 +62,54 @@ static inline bool lrng_need_entropy(void)
 	return (lrng_avail_aux_entropy() < lrng_write_wakeup_bits);
 }
 
+static atomic_t lrng_writer_wakeup_sent = ATOMIC_INIT(0);
+
+/*
+ * Rearm the writer wakeup when the entropy level rose back above the
+ * threshold such that the next downward crossing emits a new wakeup. This
+ * must be called from the paths crediting aux pool entropy - the wakeup
+ * call site itself only runs right after the seed operation drained the
+ * pool where the level is always below the threshold.
+ */
+void lrng_writer_wakeup_rearm(void)
+{
+	if (!lrng_need_entropy())
+		atomic_set(&lrng_writer_wakeup_sent, 0);
+}
+
 void lrng_writer_wakeup(void)
 {
-	if (lrng_need_entropy() && wq_has_sleeper(&lrng_write_wait)) {
-		wake_up_interruptible(&lrng_write_wait);
-		kill_fasync(&fasync, SIGIO, POLL_OUT);
+	if (!lrng_need_entropy()) {
+		lrng_writer_wakeup_rearm();
+		return;
 	}
+
+	/*
+	 * Emit one wakeup per downward crossing of the threshold instead of
+	 * one wakeup per seeding operation while the level stays low. This
+	 * loses no events: both the poll handler and the wait_event callers
+	 * check the condition before sleeping, so a waiter arriving after
+	 * the crossing observes the writable state directly.
+	 */
+	if (atomic_xchg(&lrng_writer_wakeup_sent, 1))
+		return;
+
+	if (wq_has_sleeper(&lrng_write_wait))
+		wake_up_interruptible_poll(&lrng_write_wait,
+					   EPOLLOUT | EPOLLWRNORM);
+	kill_fasync(&fasync, SIGIO, POLL_OUT);
 }
 
 void lrng_init_wakeup(void)
 {
-	wake_up_all(&lrng_init_wait);
+	/*
+	 * The keyed wakeup delivers the event mask to the wait entries which
+	 * lets epoll skip waiters not interested in EPOLLIN and wakes only
+	 * one waiter per wait queue round for entries registered with
+	 * EPOLLEXCLUSIVE. Waiters sleeping in wait_event are non-exclusive
+	 * and are woken up as before.
+	 */
+	wake_up_interruptible_poll(&lrng_init_wait, EPOLLIN | EPOLLRDNORM);
 	kill_fasync(&fasync, SIGIO, POLL_IN);
 }
 
@@ -70,23 +123,84 @@ void lrng_init_wakeup(void)
  * callers always have an SP800-90B compliant noise source when being
  * pinged.
  */
+/* State word of one readiness callback node */
+static inline void **lrng_ready_cb_state(struct random_ready_callback *rdy)
+{
+	return (void **)&rdy->list.prev;
+}
+
+static inline struct random_ready_callback *
+lrng_ready_cb(struct llist_node *node)
+{
+	return container_of((struct list_head *)node,
+			    struct random_ready_callback, list);
+}
+
 void lrng_process_ready_list(void)
 {
-	unsigned long flags;
-	struct random_ready_callback *rdy, *tmp;
+	struct llist_node *node, *next;
 
 	if (!lrng_state_operational())
 		return;
 
-	spin_lock_irqsave(&lrng_ready_list_lock, flags);
-	list_for_each_entry_safe(rdy, tmp, &lrng_ready_list, list) {
+	/*
+	 * Atomically take the entire list - a concurrent registration or
+	 * rebuild operates on disjoint nodes and needs no serialization.
+	 */
+	node = llist_del_all(&lrng_ready_list);
+	for (; node; node = next) {
+		struct random_ready_callback *rdy = lrng_ready_cb(node);
 		struct module *owner = rdy->owner;
+		void *old;
+
+		next = node->next;
 
-		list_del_init(&rdy->list);
-		rdy->func(rdy);
-		module_put(owner);
+		old = cmpxchg(lrng_ready_cb_state(rdy), LRNG_READY_QUEUED,
+			      LRNG_READY_RUNNING);
+		if (old == LRNG_READY_QUEUED) {
+			rdy->func(rdy);
+			module_put(owner);
+		}
+
+		/*
+		 * Publish that the node left the list - processed or
+		 * cancelled by a concurrent deletion which then dropped the
+		 * module reference. The release pairs with the acquire in
+		 * del_random_ready_callback after which the caller may free
+		 * the callback structure.
+		 */
+		smp_store_release(lrng_ready_cb_state(rdy), LRNG_READY_GONE);
 	}
-	spin_unlock_irqrestore(&lrng_ready_list_lock, flags);
+}
+
+/*
+ * Unlink all nodes with a pending deletion request: take the list, retire
+ * the cancelled nodes and push the remaining ones back. Racing rebuilds or
+ * drains hold disjoint node chains and thus cannot conflict.
+ */
+static void lrng_ready_list_rebuild(void)
+{
+	struct llist_node *node, *next;
+
+	node = llist_del_all(&lrng_ready_list);
+	for (; node; node = next) {
+		next = node->next;
+
+		if (cmpxchg(lrng_ready_cb_state(lrng_ready_cb(node)),
+			    LRNG_READY_CANCEL, LRNG_READY_GONE) ==
+		    LRNG_READY_CANCEL)
+			continue;
+
+		/* Still pending - put the node back */
+		llist_add(node, &lrng_ready_list);
+	}
+
+	/*
+	 * If the LRNG became operational while the chain was held privately,
+	 * the operational drain may have found an empty list - drain the
+	 * re-added nodes now.
+	 */
+	lrng_process_ready_list();
 }
 
 void lrng_debug_report_seedlevel(const char *name)
@@ -211,17 +325,26 @@ EXPORT_SYMBOL(add_interrupt_randomness);
  */
 void del_random_ready_callback(struct random_ready_callback *rdy)
 {
-	unsigned long flags;
-	struct module *owner = NULL;
-
-	spin_lock_irqsave(&lrng_ready_list_lock, flags);
-	if (!list_empty(&rdy->list)) {
-		list_del_init(&rdy->list);
-		owner = rdy->owner;
+	void *old = cmpxchg(lrng_ready_cb_state(rdy), LRNG_READY_QUEUED,
+			    LRNG_READY_CANCEL);
+
+	if (old == LRNG_READY_QUEUED) {
+		/* Deletion won against the processing - drop the reference */
+		module_put(rdy->owner);
+	} else if (old != LRNG_READY_RUNNING && old != LRNG_READY_CANCEL) {
+		/* Never registered or already processed - nothing to do */
+		return;
 	}
-	spin_unlock_irqrestore(&lrng_ready_list_lock, flags);
 
-	module_put(owner);
+	/*
+	 * Wait until the node left the list - either the callback execution
+	 * completed or a rebuild retired the cancelled node. Afterwards the
+	 * caller may release the memory of the callback structure.
+	 */
+	while (smp_load_acquire(lrng_ready_cb_state(rdy)) != LRNG_READY_GONE) {
+		lrng_ready_list_rebuild();
+		cpu_relax();
+	}
 }
 EXPORT_SYMBOL(del_random_ready_callback);
 
@@ -238,32 +361,23 @@ EXPORT_SYMBOL(del_random_ready_callback);
  */
 int add_random_ready_callback(struct random_ready_callback *rdy)
 {
-	struct module *owner;
-	unsigned long flags;
-	int err = -EALREADY;
-
 	if (likely(lrng_state_operational()))
-		return err;
+		return -EALREADY;
 
-	owner = rdy->owner;
-	if (!try_module_get(owner))
+	if (!try_module_get(rdy->owner))
 		return -ENOENT;
 
-	spin_lock_irqsave(&lrng_ready_list_lock, flags);
-	if (lrng_state_operational())
-		goto out;
-
-	owner = NULL;
-
-	list_add(&rdy->list, &lrng_ready_list);
-	err = 0;
-
-out:
-	spin_unlock_irqrestore(&lrng_ready_list_lock, flags);
+	WRITE_ONCE(*lrng_ready_cb_state(rdy), LRNG_READY_QUEUED);
+	llist_add((struct llist_node *)&rdy->list, &lrng_ready_list);
 
-	module_put(owner);
+	/*
+	 * Close the race with the LRNG becoming operational after the check
+	 * above: the drain is a noop unless the operational state is reached
+	 * and in that case invokes the callback right away.
+	 */
+	lrng_process_ready_list();
 
-	return err;
+	return 0;
 }
 EXPORT_SYMBOL(add_random_ready_callback);
 
@@ -281,7 +395,20 @@ EXPORT_SYMBOL(add_random_ready_callback);
  */
 void get_random_bytes(void *buf, int nbytes)
 {
-	lrng_drng_get_atomic((u8 *)buf, (u32)nbytes);
+	/*
+	 * Serve the request from the node-local DRNG instance when the calling
+	 * context permits taking the DRNG mutex. The detection is conservative:
+	 * preemptible() evaluates to false in any atomic context as well as on
+	 * kernels without preemption counting, and rcu_preempt_depth() covers
+	 * callers inside a preemptible RCU read-side critical section where
+	 * blocking is not permitted either. All remaining callers are served
+	 * by the atomic DRNG instance as before.
+	 */
+	if (IS_ENABLED(CONFIG_LRNG_KERNEL_NODE_LOCAL) &&
+	    preemptible() && !rcu_preempt_depth())
+		lrng_drng_get_sleep((u8 *)buf, (u32)nbytes);
+	else
+		lrng_drng_get_atomic((u8 *)buf, (u32)nbytes);
 	lrng_debug_report_seedlevel("get_random_bytes");
 }
 EXPORT_SYMBOL(get_random_bytes);
@@ -380,7 +507,9 @@ EXPORT_SYMBOL(rng_is_initialized);
 
 /************************ LRNG user output interfaces *************************/
 
-static ssize_t lrng_read_common(char __user *buf, size_t nbytes)
+static ssize_t lrng_read_common(char __user *buf, size_t nbytes,
+				int (*lrng_read_random)(u8 *outbuf,
+							u32 outbuflen))
 {
 	ssize_t ret = 0;
 	u8 tmpbuf[LRNG_DRNG_BLOCKSIZE] __aligned(LRNG_KCAPI_ALIGN);
@@ -418,7 +547,7 @@ static ssize_t lrng_read_common(char __user *buf, size_t nbytes)
 			schedule();
 		}
 
-		rc = lrng_drng_get_sleep(tmp, todo);
+		rc = lrng_read_random(tmp, todo);
 		if (rc <= 0) {
 			if (rc < 0)
 				ret = rc;
@@ -443,6 +572,126 @@ static ssize_t lrng_read_common(char __user *buf, size_t nbytes)
 	return ret;
 }
 
+/*
+ * Minimum request size for which the zero-copy generation path is attempted.
+ * For smaller requests, the page pinning overhead exceeds the cost of the
+ * avoided copy operation.
+ */
+#define LRNG_IOV_ZERO_COPY_THRESH	PAGE_SIZE
+
+/*
+ * Zero-copy read path: pin the user pages backing the iterator and let the
+ * DRNG generate the random data directly into them. This avoids the
+ * intermediate kernel buffer and the subsequent copy_to_user() of
+ * lrng_read_common() which is a full extra memory pass for bulk requests.
+ */
+static ssize_t lrng_read_iter_zero_copy(struct iov_iter *iter)
+{
+	ssize_t ret = 0;
+
+	while (iov_iter_count(iter) >= LRNG_IOV_ZERO_COPY_THRESH) {
+		struct page *pages[LRNG_DRNG_MAX_REQSIZE / PAGE_SIZE];
+		size_t start, remaining, done = 0;
+		ssize_t pinned;
+		int i, npages, rc = 0;
+
+		/* Reschedule between chunks of a large request. */
+		if (need_resched()) {
+			if (signal_pending(current)) {
+				if (ret == 0)
+					ret = -ERESTARTSYS;
+				break;
+			}
+			schedule();
+		}
+
+		pinned = iov_iter_get_pages(iter, pages, LRNG_DRNG_MAX_REQSIZE,
+					    ARRAY_SIZE(pages), &start);
+		if (pinned <= 0) {
+			if (ret == 0 && pinned < 0)
+				ret = pinned;
+			break;
+		}
+
+		remaining = pinned;
+		npages = DIV_ROUND_UP(pinned + start, PAGE_SIZE);
+		for (i = 0; i < npages; i++) {
+			size_t todo = min_t(size_t, remaining,
+					    PAGE_SIZE - start);
+
+			if (!rc) {
+				u8 *kaddr = kmap(pages[i]);
+				int rc2 = lrng_drng_get_sleep(kaddr + start,
+							      todo);
+
+				kunmap(pages[i]);
+				if (rc2 == (int)todo) {
+					flush_dcache_page(pages[i]);
+					set_page_dirty_lock(pages[i]);
+					done += todo;
+				} else {
+					rc = (rc2 < 0) ? rc2 : -EFAULT;
+				}
+			}
+
+			put_page(pages[i]);
+			remaining -= todo;
+			start = 0;
+		}
+
+		iov_iter_advance(iter, done);
+		ret += done;
+
+		if (rc) {
+			if (ret == 0)
+				ret = rc;
+			break;
+		}
+	}
+
+	return ret;
+}
+
+static ssize_t lrng_read_common_iter(struct iov_iter *iter)
+{
+	ssize_t ret = 0;
+	u8 tmpbuf[LRNG_DRNG_BLOCKSIZE] __aligned(LRNG_KCAPI_ALIGN);
+
+	if (!iov_iter_count(iter))
+		return 0;
+
+	/* Generate directly into the user pages for bulk requests. */
+	if (iov_iter_count(iter) >= LRNG_IOV_ZERO_COPY_THRESH &&
+	    iter_is_iovec(iter)) {
+		ret = lrng_read_iter_zero_copy(iter);
+		if (ret < 0 || !iov_iter_count(iter))
+			return ret;
+	}
+
+	/* Copy path for small requests and non-pinnable remainders. */
+	while (iov_iter_count(iter)) {
+		u32 todo = min_t(u32, iov_iter_count(iter), sizeof(tmpbuf));
+		int rc = lrng_drng_get_sleep(tmpbuf, todo);
+
+		if (rc <= 0) {
+			if (rc < 0 && ret == 0)
+				ret = rc;
+			break;
+		}
+
+		rc = copy_to_iter(tmpbuf, rc, iter);
+		if (!rc) {
+			if (ret == 0)
+				ret = -EFAULT;
+			break;
+		}
+		ret += rc;
+	}
+
+	memzero_explicit(tmpbuf, sizeof(tmpbuf));
+	return ret;
+}
+
 static ssize_t
 lrng_read_common_block(int nonblock, char __user *buf, size_t nbytes)
 {
@@ -461,7 +710,7 @@ lrng_read_common_block(int nonblock, char __user *buf, size_t nbytes)
 			return ret;
 	}
 
-	return lrng_read_common(buf, nbytes);
+	return lrng_read_common(buf, nbytes, lrng_drng_get_sleep);
 }
 
 static ssize_t lrng_drng_read_block(struct file *file, char __user *buf,
@@ -487,29 +736,47 @@ static __poll_t lrng_random_poll(struct file *file, poll_table *wait)
 	return mask;
 }
 
-static ssize_t lrng_drng_write_common(const char __user *buffer, size_t count,
-				      u32 entropy_bits)
+static ssize_t lrng_drng_write_common_iter(struct iov_iter *iter,
+					   u32 entropy_bits)
 {
 	ssize_t ret = 0;
 	u8 buf[64] __aligned(LRNG_KCAPI_ALIGN);
-	const char __user *p = buffer;
+	u8 *tmp_large = NULL, *tmp = buf;
+	u32 tmplen = sizeof(buf);
+	size_t count = iov_iter_count(iter);
 	u32 orig_entropy_bits = entropy_bits;
 
 	if (!lrng_get_available())
 		return -EAGAIN;
 
 	count = min_t(size_t, count, INT_MAX);
+
+	/*
+	 * Batch bulk injections: inserting one large buffer into the aux pool
+	 * takes the pool lock once and runs one hash update stream over the
+	 * entire buffer instead of locking and hashing per 64-byte chunk.
+	 */
+	if (!CONFIG_BASE_SMALL && (count > sizeof(buf))) {
+		tmplen = min_t(u32, count, LRNG_DRNG_MAX_REQSIZE);
+		tmp_large = kmalloc(tmplen + LRNG_KCAPI_ALIGN, GFP_KERNEL);
+		if (!tmp_large)
+			tmplen = sizeof(buf);
+		else
+			tmp = PTR_ALIGN(tmp_large, LRNG_KCAPI_ALIGN);
+	}
+
 	while (count > 0) {
-		size_t bytes = min_t(size_t, count, sizeof(buf));
+		size_t bytes = min_t(size_t, count, tmplen);
 		u32 ent = min_t(u32, bytes<<3, entropy_bits);
 
-		if (copy_from_user(&buf, p, bytes))
-			return -EFAULT;
+		if (copy_from_iter(tmp, bytes, iter) != bytes) {
+			ret = -EFAULT;
+			goto out;
+		}
 		/* Inject data into entropy pool */
-		lrng_pool_insert_aux(buf, bytes, ent);
+		lrng_pool_insert_aux(tmp, bytes, ent);
 
 		count -= bytes;
-		p += bytes;
 		ret += bytes;
 		entropy_bits -= ent;
 
@@ -520,11 +787,37 @@ static ssize_t lrng_drng_write_common(const char __user *buffer, size_t count,
 	if (!orig_entropy_bits)
 		lrng_drng_force_reseed();
 
+out:
+	if (tmp_large)
+		kfree_sensitive(tmp_large);
+	else
+		memzero_explicit(buf, sizeof(buf));
 	return ret;
 }
 
-static ssize_t lrng_drng_read(struct file *file, char __user *buf,
-			      size_t nbytes, loff_t *ppos)
+static ssize_t lrng_drng_write_common(const char __user *buffer, size_t count,
+				      u32 entropy_bits)
+{
+	struct iov_iter iter;
+	struct iovec iov;
+	int ret;
+
+	ret = import_single_range(WRITE, (void __user *)buffer, count, &iov,
+				  &iter);
+	if (unlikely(ret))
+		return ret;
+
+	return lrng_drng_write_common_iter(&iter, entropy_bits);
+}
+
+/*
+ * Read path of getrandom(2) with the GRND_INSECURE flag: the caller waived
+ * the guarantee of fully seeded random numbers, thus the request is served
+ * from the per-CPU ChaCha20 sub-instances which do not contend for the DRNG
+ * lock. Without CONFIG_LRNG_INSECURE_FAST_PATH, lrng_cc20_get_insecure()
+ * falls back to the common DRNG request path.
+ */
+static ssize_t lrng_drng_read_insecure(char __user *buf, size_t nbytes)
 {
 	if (!lrng_state_min_seeded())
 		pr_notice_ratelimited("%s - use of insufficiently seeded DRNG (%zu bytes read)\n",
@@ -533,13 +826,25 @@ static ssize_t lrng_drng_read(struct file *file, char __user *buf,
 		pr_debug_ratelimited("%s - use of not fully seeded DRNG (%zu bytes read)\n",
 				     current->comm, nbytes);
 
-	return lrng_read_common(buf, nbytes);
+	return lrng_read_common(buf, nbytes, lrng_cc20_get_insecure);
 }
 
-static ssize_t lrng_drng_write(struct file *file, const char __user *buffer,
-			       size_t count, loff_t *ppos)
+static ssize_t lrng_drng_read_iter(struct kiocb *kiocb, struct iov_iter *iter)
 {
-	return lrng_drng_write_common(buffer, count, 0);
+	if (!lrng_state_min_seeded())
+		pr_notice_ratelimited("%s - use of insufficiently seeded DRNG (%zu bytes read)\n",
+				      current->comm, iov_iter_count(iter));
+	else if (!lrng_state_operational())
+		pr_debug_ratelimited("%s - use of not fully seeded DRNG (%zu bytes read)\n",
+				     current->comm, iov_iter_count(iter));
+
+	return lrng_read_common_iter(iter);
+}
+
+static ssize_t lrng_drng_write_iter(struct kiocb *kiocb,
+				    struct iov_iter *iter)
+{
+	return lrng_drng_write_common_iter(iter, 0);
 }
 
 static long lrng_ioctl(struct file *f, unsigned int cmd, unsigned long arg)
@@ -613,7 +918,7 @@ static int lrng_fasync(int fd, struct file *filp, int on)
 
 const struct file_operations random_fops = {
 	.read  = lrng_drng_read_block,
-	.write = lrng_drng_write,
+	.write_iter = lrng_drng_write_iter,
 	.poll  = lrng_random_poll,
 	.unlocked_ioctl = lrng_ioctl,
 	.compat_ioctl = compat_ptr_ioctl,
@@ -622,8 +927,11 @@ const struct file_operations random_fops = {
 };
 
 const struct file_operations urandom_fops = {
-	.read  = lrng_drng_read,
-	.write = lrng_drng_write,
+	.read_iter = lrng_drng_read_iter,
+	.write_iter = lrng_drng_write_iter,
+#ifdef CONFIG_LRNG_SHARED_PAGES
+	.mmap = lrng_shared_pages_mmap,
+#endif
 	.unlocked_ioctl = lrng_ioctl,
 	.compat_ioctl = compat_ptr_ioctl,
 	.fasync = lrng_fasync,
@@ -648,7 +956,7 @@ SYSCALL_DEFINE3(getrandom, char __user *, buf, size_t, count,
 		count = INT_MAX;
 
 	if (flags & GRND_INSECURE)
-		return lrng_drng_read(NULL, buf, count, NULL);
+		return lrng_drng_read_insecure(buf, count);
 
 	return lrng_read_common_block(flags & GRND_NONBLOCK, buf, count);
 }
@@ -11,7 +11,7 @@
 #include <linux/init.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
-#include <linux/rwlock.h>
+#include <linux/rcupdate.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 
@@ -110,8 +110,21 @@
 /*
  * This definition must provide a buffer that is equal to SHASH_DESC_ON_STACK
  * as it will be casted into a struct shash_desc.
+ *
+ * If the switching support is configured, the pools may hold the descriptor
+ * of any hash offered by the kernel crypto API and thus must be sized for
+ * the worst case. Without switching support, the pools only ever hold the
+ * state of the built-in hash whose size is known at compile time which
+ * shrinks the per-CPU pools and the aux pool accordingly.
  */
-#define LRNG_POOL_SIZE	(sizeof(struct shash_desc) + HASH_MAX_DESCSIZE)
+#ifdef CONFIG_LRNG_DRNG_SWITCH
+# define LRNG_ATOMIC_DESC_SIZE		HASH_MAX_DESCSIZE
+#elif defined(CONFIG_CRYPTO_LIB_SHA256)
+# define LRNG_ATOMIC_DESC_SIZE		sizeof(struct sha256_state)
+#else
+# define LRNG_ATOMIC_DESC_SIZE		sizeof(struct sha1_state)
+#endif
+#define LRNG_POOL_SIZE	(sizeof(struct shash_desc) + LRNG_ATOMIC_DESC_SIZE)
 
 /************************ Default DRNG implementation *************************/
 
@@ -124,17 +137,32 @@ void lrng_cc20_init_state(struct chacha20_state *state);
 #ifdef CONFIG_SYSCTL
 void lrng_pool_inc_numa_node(void);
 void lrng_proc_update_max_write_thresh(u32 new_digestsize);
+void lrng_stats_update(void);
 #else
 static inline void lrng_pool_inc_numa_node(void) { }
 static inline void lrng_proc_update_max_write_thresh(u32 new_digestsize) { }
+static inline void lrng_stats_update(void) { }
 #endif
 
+/************************** Shared random pages *******************************/
+
+struct file;
+struct vm_area_struct;
+
+#ifdef CONFIG_LRNG_SHARED_PAGES
+int lrng_shared_pages_mmap(struct file *file, struct vm_area_struct *vma);
+void lrng_shared_pages_reseed(void);
+#else /* CONFIG_LRNG_SHARED_PAGES */
+static inline void lrng_shared_pages_reseed(void) { }
+#endif /* CONFIG_LRNG_SHARED_PAGES */
+
 /****************************** LRNG interfaces *******************************/
 
 extern u32 lrng_write_wakeup_bits;
 extern int lrng_drng_reseed_max_time;
 
 void lrng_writer_wakeup(void);
+void lrng_writer_wakeup_rearm(void);
 void lrng_init_wakeup(void);
 void lrng_debug_report_seedlevel(const char *name);
 void lrng_process_ready_list(void);
@@ -181,9 +209,6 @@ static inline void lrng_arch_es_state(unsigned char *buf, size_t buflen) { }
 void lrng_pcpu_reset(void);
 u32 lrng_pcpu_avail_pool_size(void);
 u32 lrng_pcpu_avail_entropy(void);
-int lrng_pcpu_switch_hash(int node,
-			  const struct lrng_crypto_cb *new_cb, void *new_hash,
-			  const struct lrng_crypto_cb *old_cb);
 u32 lrng_pcpu_pool_hash(u8 *outbuf, u32 requested_bits, bool fully_seeded);
 void lrng_pcpu_array_add_u32(u32 data);
 u32 lrng_gcd_analyze(u32 *history, size_t nelem);
@@ -192,12 +217,6 @@ void lrng_irq_es_state(unsigned char *buf, size_t buflen);
 static inline void lrng_pcpu_reset(void) { }
 static inline u32 lrng_pcpu_avail_pool_size(void) { return 0; }
 static inline u32 lrng_pcpu_avail_entropy(void) { return 0; }
-static inline int lrng_pcpu_switch_hash(int node,
-			  const struct lrng_crypto_cb *new_cb, void *new_hash,
-			  const struct lrng_crypto_cb *old_cb)
-{
-	return 0;
-}
 static inline u32 lrng_pcpu_pool_hash(u8 *outbuf, u32 requested_bits,
 				      bool fully_seeded)
 {
@@ -209,23 +228,37 @@ static inline void lrng_irq_es_state(unsigned char *buf, size_t buflen) { }
 
 /****************************** DRNG processing *******************************/
 
+/*
+ * Reference to the hash used for reading the entropy pools together with the
+ * crypto callbacks operating it. Both are replaced as one unit when switching
+ * the crypto backend: readers either obtain the instance-wide reference under
+ * RCU protection or use the reference recorded with the entropy pool they
+ * operate on whose replacement is serialized with the respective pool lock.
+ */
+struct lrng_drng_hash {
+	const struct lrng_crypto_cb *crypto_cb;	/* Crypto callbacks */
+	void *hash;				/* Hash handle */
+};
+
+/* Hash reference of the standby ChaCha20 DRNG - lrng_drng.c */
+extern struct lrng_drng_hash lrng_cc20_drng_hash;
+
 /* DRNG state handle */
 struct lrng_drng {
 	void *drng;				/* DRNG handle */
-	void *hash;				/* Hash handle */
+	struct lrng_drng_hash __rcu *hash_state; /* Hash reference */
 	const struct lrng_crypto_cb *crypto_cb;	/* Crypto callbacks */
 	atomic_t requests;			/* Number of DRNG requests */
 	atomic_t requests_since_fully_seeded;	/* Number DRNG requests since
 						   last fully seeded */
 	unsigned long last_seeded;		/* Last time it was seeded */
+	unsigned long next_ent_check;		/* Next reseed entropy query */
 	bool fully_seeded;			/* Is DRNG fully seeded? */
 	bool force_reseed;			/* Force a reseed */
 
 	/* Lock write operations on DRNG state, DRNG replacement of crypto_cb */
 	struct mutex lock;
 	spinlock_t spin_lock;
-	/* Lock *hash replacement - always take before DRNG lock */
-	rwlock_t hash_lock;
 };
 
 extern struct mutex lrng_crypto_cb_update;
@@ -298,6 +331,18 @@ int lrng_drng_get_sleep(u8 *outbuf, u32 outbuflen);
 void lrng_drng_force_reseed(void);
 void lrng_drng_seed_work(struct work_struct *dummy);
 
+/* Insecure per-CPU ChaCha20 fast path - lrng_chacha20.c */
+#ifdef CONFIG_LRNG_INSECURE_FAST_PATH
+int lrng_cc20_get_insecure(u8 *outbuf, u32 outbuflen);
+void lrng_cc20_invalidate_insecure(void);
+#else	/* CONFIG_LRNG_INSECURE_FAST_PATH */
+static inline int lrng_cc20_get_insecure(u8 *outbuf, u32 outbuflen)
+{
+	return lrng_drng_get_sleep(outbuf, outbuflen);
+}
+static inline void lrng_cc20_invalidate_insecure(void) { }
+#endif	/* CONFIG_LRNG_INSECURE_FAST_PATH */
+
 #ifdef CONFIG_NUMA
 struct lrng_drng **lrng_drng_instances(void);
 void lrng_drngs_numa_alloc(void);
@@ -306,6 +351,40 @@ static inline struct lrng_drng **lrng_drng_instances(void) { return NULL; }
 static inline void lrng_drngs_numa_alloc(void) { return; }
 #endif /* CONFIG_NUMA */
 
+/*
+ * The DRNG instance array returned by lrng_drng_instances() is indexed by NUMA
+ * node. With CONFIG_LRNG_PERCPU_DRNG, the granularity of the instances is
+ * increased to one DRNG per CPU and the array is indexed by CPU number. The
+ * following helpers abstract the indexing such that the instance handling
+ * code is agnostic of the used granularity.
+ */
+#ifdef CONFIG_LRNG_PERCPU_DRNG
+#define lrng_for_each_drng_instance(idx)	for_each_online_cpu(idx)
+static inline u32 lrng_drng_max_instances(void) { return nr_cpu_ids; }
+/*
+ * Use the raw CPU number as a stale value merely directs the caller to
+ * the DRNG instance of a different CPU which is functionally correct.
+ */
+static inline int lrng_drng_curr_instance(void)
+{
+	return raw_smp_processor_id();
+}
+static inline int lrng_cpu_to_instance(int cpu) { return cpu; }
+static inline int lrng_instance_mem_node(int idx) { return cpu_to_node(idx); }
+static inline int lrng_instance_bind_cpu(int idx) { return idx; }
+#else /* CONFIG_LRNG_PERCPU_DRNG */
+#define lrng_for_each_drng_instance(idx)	for_each_online_node(idx)
+static inline u32 lrng_drng_max_instances(void) { return nr_node_ids; }
+static inline int lrng_drng_curr_instance(void) { return numa_node_id(); }
+static inline int lrng_cpu_to_instance(int cpu) { return cpu_to_node(cpu); }
+static inline int lrng_instance_mem_node(int idx) { return idx; }
+/* May return >= nr_cpu_ids when the node has no online CPU */
+static inline int lrng_instance_bind_cpu(int idx)
+{
+	return cpumask_any_and(cpumask_of_node(idx), cpu_online_mask);
+}
+#endif /* CONFIG_LRNG_PERCPU_DRNG */
+
 /************************* Entropy sources management *************************/
 
 enum lrng_external_noise_source {
@@ -341,14 +420,19 @@ void lrng_unset_fully_seeded(struct lrng_drng *drng);
 void lrng_fill_seed_buffer(struct entropy_buf *entropy_buf, u32 requested_bits);
 void lrng_init_ops(struct entropy_buf *eb);
 
+#ifdef CONFIG_LRNG_SELFTEST
+bool lrng_selftest_completed(void);
+#else	/* CONFIG_LRNG_SELFTEST */
+static inline bool lrng_selftest_completed(void) { return true; }
+#endif	/* CONFIG_LRNG_SELFTEST */
+
 /*********************** Auxiliary Pool Entropy Source ************************/
 
 u32 lrng_avail_aux_entropy(void);
 void lrng_aux_es_state(unsigned char *buf, size_t buflen);
 u32 lrng_get_digestsize(void);
 void lrng_pool_set_entropy(u32 entropy_bits);
-int lrng_aux_switch_hash(const struct lrng_crypto_cb *new_cb, void *new_hash,
-			 const struct lrng_crypto_cb *old_cb);
+int lrng_aux_switch_hash(const struct lrng_drng_hash *new_state);
 int lrng_pool_insert_aux(const u8 *inbuf, u32 inbuflen, u32 entropy_bits);
 void lrng_get_backtrack_aux(struct entropy_buf *entropy_buf,
 			    u32 requested_bits);
@@ -401,6 +485,13 @@ lrng_health_test(u32 now_time) { return lrng_health_pass; }
 static inline void lrng_health_disable(void) { }
 #endif	/* CONFIG_LRNG_HEALTH_TESTS */
 
+#ifdef CONFIG_LRNG_HEALTH_TESTS_BATCH
+u32 lrng_health_test_batch(const u32 *array, u32 first_idx, u32 last_idx);
+#else	/* CONFIG_LRNG_HEALTH_TESTS_BATCH */
+static inline u32 lrng_health_test_batch(const u32 *array, u32 first_idx,
+					 u32 last_idx) { return 0; }
+#endif	/* CONFIG_LRNG_HEALTH_TESTS_BATCH */
+
 /****************************** Helper code ***********************************/
 
 static inline u32 atomic_read_u32(atomic_t *v)
@@ -410,24 +501,53 @@ static inline u32 atomic_read_u32(atomic_t *v)
 
 /******************** Crypto Primitive Switching Support **********************/
 
+/*
+ * Obtain the instance-wide hash reference of a DRNG instance. The reference
+ * and all data obtained from it may only be used under the RCU read side
+ * protection which the caller must drop with lrng_drng_hash_put.
+ */
 #ifdef CONFIG_LRNG_DRNG_SWITCH
-static inline void lrng_hash_lock(struct lrng_drng *drng, unsigned long *flags)
+static inline const struct lrng_drng_hash *
+lrng_drng_hash_get(struct lrng_drng *drng)
 {
-	read_lock_irqsave(&drng->hash_lock, *flags);
+	rcu_read_lock();
+	return rcu_dereference(drng->hash_state);
 }
 
-static inline void lrng_hash_unlock(struct lrng_drng *drng, unsigned long flags)
+static inline void lrng_drng_hash_put(void)
 {
-	read_unlock_irqrestore(&drng->hash_lock, flags);
+	rcu_read_unlock();
 }
 #else /* CONFIG_LRNG_DRNG_SWITCH */
-static inline void lrng_hash_lock(struct lrng_drng *drng, unsigned long *flags)
-{ }
+static inline const struct lrng_drng_hash *
+lrng_drng_hash_get(struct lrng_drng *drng)
+{
+	return &lrng_cc20_drng_hash;
+}
 
-static inline void lrng_hash_unlock(struct lrng_drng *drng, unsigned long flags)
-{ }
+static inline void lrng_drng_hash_put(void) { }
 #endif /* CONFIG_LRNG_DRNG_SWITCH */
 
+/*
+ * Replace the hash reference used by the per-CPU entropy pools of one DRNG
+ * instance - the operation also publishes the new reference for the instance.
+ */
+#ifdef CONFIG_LRNG_IRQ
+int lrng_pcpu_switch_hash(struct lrng_drng *drng, int node,
+			  struct lrng_drng_hash *new_state);
+#else	/* CONFIG_LRNG_IRQ */
+static inline int lrng_pcpu_switch_hash(struct lrng_drng *drng, int node,
+					struct lrng_drng_hash *new_state)
+{
+	if (!IS_ENABLED(CONFIG_LRNG_DRNG_SWITCH))
+		return -EOPNOTSUPP;
+
+	/* Without per-CPU entropy pools, only publish the new reference. */
+	rcu_assign_pointer(drng->hash_state, new_state);
+	return 0;
+}
+#endif	/* CONFIG_LRNG_IRQ */
+
 /*************************** Auxiliary functions ******************************/
 
 void invalidate_batched_entropy(void);
@@ -482,4 +602,30 @@ bool lrng_perf_time(u32 start);
 static inline bool lrng_perf_time(u32 start) { return false; }
 #endif /*CONFIG_LRNG_IRQ_PERF */
 
+/*
+ * Stages of the interrupt handling path instrumented with per-CPU cycle
+ * histograms. The enum values index the histogram array.
+ */
+enum lrng_perf_stage {
+	lrng_perf_stage_health,
+	lrng_perf_stage_insert,
+	lrng_perf_stage_compress,
+
+	lrng_perf_stage_max
+};
+
+#ifdef CONFIG_LRNG_IRQ_PERF_STAGES
+void lrng_perf_stage_time(enum lrng_perf_stage stage, u32 start);
+#else /* CONFIG_LRNG_IRQ_PERF_STAGES */
+static inline void lrng_perf_stage_time(enum lrng_perf_stage stage,
+					u32 start) { }
+#endif /* CONFIG_LRNG_IRQ_PERF_STAGES */
+
+/* Take a cycle reading only when the stage histograms are configured */
+static inline u32 lrng_perf_stage_start(void)
+{
+	return IS_ENABLED(CONFIG_LRNG_IRQ_PERF_STAGES) ?
+	       random_get_entropy() : 0;
+}
+
 #endif /* _LRNG_INTERNAL_H */
@@ -8,21 +8,64 @@
 #define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
 
 #include <crypto/hash.h>
+#include <linux/percpu.h>
 
 #include "lrng_kcapi_hash.h"
 
 struct lrng_hash_info {
 	struct crypto_shash *tfm;
+	/*
+	 * Cached descriptor state after crypto_shash_init - one copy per CPU
+	 * so that the copy read during the pool operations stays local to the
+	 * operating CPU. NULL if the cache could not be allocated in which
+	 * case the state is recomputed on every operation.
+	 */
+	char __percpu *init_state;
+	unsigned int descsize;		/* Size of the descriptor state */
 };
 
 static inline void _lrng_kcapi_hash_free(struct lrng_hash_info *lrng_hash)
 {
 	struct crypto_shash *tfm = lrng_hash->tfm;
 
+	free_percpu(lrng_hash->init_state);
 	crypto_free_shash(tfm);
 	kfree(lrng_hash);
 }
 
+/*
+ * Pre-compute the descriptor state resulting from crypto_shash_init once and
+ * replicate it to all CPUs. The state is independent of the CPU computing it,
+ * thus every pool operation can start from the cached copy with one memcpy
+ * instead of re-running the init operation of the cipher implementation.
+ */
+static void lrng_kcapi_hash_init_cache(struct lrng_hash_info *lrng_hash)
+{
+	SHASH_DESC_ON_STACK(shash, lrng_hash->tfm);
+	int cpu;
+
+	lrng_hash->descsize = crypto_shash_descsize(lrng_hash->tfm);
+	lrng_hash->init_state = __alloc_percpu(lrng_hash->descsize,
+					       __alignof__(struct shash_desc));
+	/* Operate without the cache when the allocation fails. */
+	if (!lrng_hash->init_state)
+		return;
+
+	shash->tfm = lrng_hash->tfm;
+	if (crypto_shash_init(shash)) {
+		free_percpu(lrng_hash->init_state);
+		lrng_hash->init_state = NULL;
+		goto out;
+	}
+
+	for_each_possible_cpu(cpu)
+		memcpy(per_cpu_ptr(lrng_hash->init_state, cpu),
+		       shash_desc_ctx(shash), lrng_hash->descsize);
+
+out:
+	shash_desc_zero(shash);
+}
+
 void *lrng_kcapi_hash_alloc(const char *name)
 {
 	struct lrng_hash_info *lrng_hash;
@@ -48,6 +91,7 @@ void *lrng_kcapi_hash_alloc(const char *name)
 	}
 
 	lrng_hash->tfm = tfm;
+	lrng_kcapi_hash_init_cache(lrng_hash);
 
 	pr_info("Hash %s allocated\n", name);
 
@@ -79,6 +123,20 @@ int lrng_kcapi_hash_init(struct shash_desc *shash, void *hash)
 	struct crypto_shash *tfm = lrng_hash->tfm;
 
 	shash->tfm = tfm;
+
+	/*
+	 * Start from the cached initialized descriptor state. All per-CPU
+	 * copies are identical, thus a CPU migration between obtaining the
+	 * pointer and the memcpy is harmless and the caller does not need
+	 * to disable preemption.
+	 */
+	if (likely(lrng_hash->init_state)) {
+		memcpy(shash_desc_ctx(shash),
+		       raw_cpu_ptr(lrng_hash->init_state),
+		       lrng_hash->descsize);
+		return 0;
+	}
+
 	return crypto_shash_init(shash);
 }
 EXPORT_SYMBOL(lrng_kcapi_hash_init);
@@ -19,7 +19,7 @@ struct lrng_drng **lrng_drng_instances(void)
 	return smp_load_acquire(&lrng_drng);
 }
 
-/* Allocate the data structures for the per-NUMA node DRNGs */
+/* Allocate the data structures for the per-NUMA-node / per-CPU DRNGs */
 static void _lrng_drngs_numa_alloc(struct work_struct *work)
 {
 	struct lrng_drng **drngs;
@@ -29,12 +29,14 @@ static void _lrng_drngs_numa_alloc(struct work_struct *work)
 
 	mutex_lock(&lrng_crypto_cb_update);
 
-	/* per-NUMA-node DRNGs are already present */
+	/* per-NUMA-node / per-CPU DRNGs are already present */
 	if (lrng_drng)
 		goto unlock;
 
-	drngs = kcalloc(nr_node_ids, sizeof(void *), GFP_KERNEL|__GFP_NOFAIL);
-	for_each_online_node(node) {
+	drngs = kcalloc(lrng_drng_max_instances(), sizeof(void *),
+			GFP_KERNEL|__GFP_NOFAIL);
+	lrng_for_each_drng_instance(node) {
+		struct lrng_drng_hash *hash_state;
 		struct lrng_drng *drng;
 
 		if (!init_drng_used) {
@@ -44,7 +46,8 @@ static void _lrng_drngs_numa_alloc(struct work_struct *work)
 		}
 
 		drng = kmalloc_node(sizeof(struct lrng_drng),
-				     GFP_KERNEL|__GFP_NOFAIL, node);
+				     GFP_KERNEL|__GFP_NOFAIL,
+				     lrng_instance_mem_node(node));
 		memset(drng, 0, sizeof(lrng_drng));
 
 		drng->crypto_cb = lrng_drng_init->crypto_cb;
@@ -55,24 +58,28 @@ static void _lrng_drngs_numa_alloc(struct work_struct *work)
 			goto err;
 		}
 
-		drng->hash = drng->crypto_cb->lrng_hash_alloc();
-		if (IS_ERR(drng->hash)) {
+		hash_state = kmalloc_node(sizeof(struct lrng_drng_hash),
+					  GFP_KERNEL|__GFP_NOFAIL,
+					  lrng_instance_mem_node(node));
+		hash_state->crypto_cb = drng->crypto_cb;
+		hash_state->hash = hash_state->crypto_cb->lrng_hash_alloc();
+		if (IS_ERR(hash_state->hash)) {
 			drng->crypto_cb->lrng_drng_dealloc(drng->drng);
+			kfree(hash_state);
 			kfree(drng);
 			goto err;
 		}
+		RCU_INIT_POINTER(drng->hash_state, hash_state);
 
 		mutex_init(&drng->lock);
 		spin_lock_init(&drng->spin_lock);
-		rwlock_init(&drng->hash_lock);
 
 		/*
-		 * Switch the hash used by the per-CPU pool.
-		 * We do not need to lock the new hash as it is not usable yet
-		 * due to **drngs not yet being initialized.
+		 * Switch the hash used by the per-CPU pool. The new hash is
+		 * not usable by other contexts yet due to **drngs not yet
+		 * being initialized.
 		 */
-		if (lrng_pcpu_switch_hash(node, drng->crypto_cb, drng->hash,
-					  &lrng_cc20_crypto_cb))
+		if (lrng_pcpu_switch_hash(drng, node, hash_state))
 			goto err;
 
 		/*
@@ -83,8 +90,9 @@ static void _lrng_drngs_numa_alloc(struct work_struct *work)
 		drngs[node] = drng;
 
 		lrng_pool_inc_numa_node();
-		pr_info("DRNG and entropy pool read hash for NUMA node %d allocated\n",
-			node);
+		pr_info("DRNG and entropy pool read hash for %s %d allocated\n",
+			IS_ENABLED(CONFIG_LRNG_PERCPU_DRNG) ?
+				"CPU" : "NUMA node", node);
 	}
 
 	/* counterpart to smp_load_acquire in lrng_drng_instances */
@@ -94,16 +102,27 @@ static void _lrng_drngs_numa_alloc(struct work_struct *work)
 	}
 
 err:
-	for_each_online_node(node) {
+	lrng_for_each_drng_instance(node) {
 		struct lrng_drng *drng = drngs[node];
 
 		if (drng == lrng_drng_init)
 			continue;
 
 		if (drng) {
-			lrng_pcpu_switch_hash(node, &lrng_cc20_crypto_cb, NULL,
-					      drng->crypto_cb);
-			drng->crypto_cb->lrng_hash_dealloc(drng->hash);
+			struct lrng_drng_hash *hash_state =
+				rcu_dereference_protected(drng->hash_state,
+					lockdep_is_held(&lrng_crypto_cb_update));
+
+			/*
+			 * Move the per-CPU pools back to the standby ChaCha20
+			 * hash before the node-local hash is released. The
+			 * instances were never published, thus no reader can
+			 * hold the hash reference beyond this point.
+			 */
+			lrng_pcpu_switch_hash(drng, node, &lrng_cc20_drng_hash);
+			hash_state->crypto_cb->lrng_hash_dealloc(
+							hash_state->hash);
+			kfree(hash_state);
 			drng->crypto_cb->lrng_drng_dealloc(drng->drng);
 			kfree(drng);
 		}
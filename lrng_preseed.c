@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: GPL-2.0 OR BSD-2-Clause
+/*
+ * LRNG early boot seed injection
+ *
+ * A seed blob prepared by the boot loader or firmware and placed into
+ * physical memory is injected into the auxiliary entropy pool at
+ * core_initcall time. The location and size of the blob are provided with
+ * the kernel command line options lrng_preseed.addr and lrng_preseed.len.
+ * The entropy credited for the blob is configurable with
+ * lrng_preseed.entropy_bits and defaults to zero, i.e. the seed data is
+ * mixed into the entropy pool but not credited.
+ *
+ * The seed generation counter exported via
+ * /sys/module/lrng_preseed/parameters/generation allows user space to
+ * verify that its seed blob was consumed and to write back a fresh seed
+ * during shutdown for the next boot.
+ *
+ * Copyright (C) 2021, Stephan Mueller <smueller@chronox.de>
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/init.h>
+#include <linux/io.h>
+#include <linux/module.h>
+
+#include "lrng_internal.h"
+
+/* Maximum size of the seed blob accepted from the boot loader */
+#define LRNG_PRESEED_MAX_LEN	PAGE_SIZE
+
+static unsigned long long lrng_preseed_addr = 0;
+module_param_named(addr, lrng_preseed_addr, ullong, 0444);
+MODULE_PARM_DESC(addr, "Physical address of the seed blob handed over by the boot loader\n");
+
+static unsigned int lrng_preseed_len = 0;
+module_param_named(len, lrng_preseed_len, uint, 0444);
+MODULE_PARM_DESC(len, "Size of the seed blob in bytes\n");
+
+static unsigned int lrng_preseed_entropy_bits = 0;
+module_param_named(entropy_bits, lrng_preseed_entropy_bits, uint, 0444);
+MODULE_PARM_DESC(entropy_bits, "Amount of entropy in bits credited for the seed blob\n");
+
+static atomic_t lrng_preseed_generation = ATOMIC_INIT(0);
+
+static int lrng_preseed_generation_get(char *val,
+				       const struct kernel_param *kp)
+{
+	return snprintf(val, PAGE_SIZE, "%d",
+			atomic_read(&lrng_preseed_generation));
+}
+
+static const struct kernel_param_ops lrng_preseed_generation_ops = {
+	.get = lrng_preseed_generation_get,
+};
+module_param_cb(generation, &lrng_preseed_generation_ops, NULL, 0444);
+MODULE_PARM_DESC(generation, "Number of seed blobs injected into the entropy pool\n");
+
+static int __init lrng_preseed_init(void)
+{
+	u32 entropy_bits;
+	void *seed;
+	int ret;
+
+	if (!lrng_preseed_addr || !lrng_preseed_len)
+		return 0;
+
+	if (lrng_preseed_len > LRNG_PRESEED_MAX_LEN) {
+		pr_warn("seed blob too large (%u bytes), truncating to %lu bytes\n",
+			lrng_preseed_len, LRNG_PRESEED_MAX_LEN);
+		lrng_preseed_len = LRNG_PRESEED_MAX_LEN;
+	}
+
+	seed = memremap(lrng_preseed_addr, lrng_preseed_len, MEMREMAP_WB);
+	if (!seed) {
+		pr_warn("cannot map seed blob at address 0x%llx\n",
+			lrng_preseed_addr);
+		return -ENOMEM;
+	}
+
+	/* The credited entropy cannot exceed the size of the seed data. */
+	entropy_bits = min_t(u32, lrng_preseed_entropy_bits,
+			     lrng_preseed_len << 3);
+
+	ret = lrng_pool_insert_aux(seed, lrng_preseed_len, entropy_bits);
+	if (ret) {
+		pr_warn("injection of seed blob failed (%d)\n", ret);
+	} else {
+		atomic_inc(&lrng_preseed_generation);
+		pr_info("%u bytes of seed data injected with %u bits of entropy credited\n",
+			lrng_preseed_len, entropy_bits);
+	}
+
+	/*
+	 * Wipe the handoff memory - the seed blob must never be used for
+	 * more than one boot.
+	 */
+	memzero_explicit(seed, lrng_preseed_len);
+	memunmap(seed);
+
+	return ret;
+}
+
+core_initcall(lrng_preseed_init);
@@ -78,6 +78,63 @@ static int lrng_proc_do_poolsize(struct ctl_table *table, int write,
 	return proc_dointvec(&fake_table, write, buffer, lenp, ppos);
 }
 
+/*
+ * Cached per-entropy-source estimates for the statistics interfaces: the
+ * authoritative entropy estimate of the interrupt ES requires a walk over
+ * all per-CPU collection pools which is visible on large machines when
+ * monitoring polls the status interfaces at a high rate. The cache is
+ * updated when entropy is collected or inserted and is refreshed lazily
+ * when a reader finds it older than LRNG_STATS_MAX_AGE. Readers between
+ * two refreshes are served with plain atomic reads.
+ */
+struct lrng_stats {
+	atomic_t irq_entropy_bits;
+	atomic_t aux_entropy_bits;
+	atomic_t arch_entropy_bits;
+	atomic_t jent_entropy_bits;
+	unsigned long last_update;	/* jiffies of last refresh */
+};
+
+static struct lrng_stats lrng_stats;
+
+/* Maximum age of the cached estimates served to readers */
+#define LRNG_STATS_MAX_AGE	HZ
+
+void lrng_stats_update(void)
+{
+	u32 ent_thresh = lrng_security_strength();
+
+	atomic_set(&lrng_stats.irq_entropy_bits, lrng_pcpu_avail_entropy());
+	atomic_set(&lrng_stats.aux_entropy_bits, lrng_avail_aux_entropy());
+	atomic_set(&lrng_stats.arch_entropy_bits,
+		   lrng_archrandom_entropylevel(ent_thresh));
+	atomic_set(&lrng_stats.jent_entropy_bits,
+		   lrng_jent_entropylevel(ent_thresh));
+	WRITE_ONCE(lrng_stats.last_update, jiffies);
+}
+
+static void lrng_stats_refresh(void)
+{
+	if (time_after(jiffies,
+		       READ_ONCE(lrng_stats.last_update) + LRNG_STATS_MAX_AGE))
+		lrng_stats_update();
+}
+
+static int lrng_proc_do_stats_entropy(struct ctl_table *table, int write,
+				      void *buffer, size_t *lenp, loff_t *ppos)
+{
+	struct ctl_table fake_table;
+	int entropy_count;
+
+	lrng_stats_refresh();
+	entropy_count = atomic_read((atomic_t *)table->data);
+
+	fake_table.data = &entropy_count;
+	fake_table.maxlen = sizeof(entropy_count);
+
+	return proc_dointvec(&fake_table, write, buffer, lenp, ppos);
+}
+
 static int lrng_min_write_thresh;
 static int lrng_max_write_thresh = (LRNG_WRITE_WAKEUP_ENTROPY << 3);
 static char lrng_sysctl_bootid[16];
@@ -124,6 +181,34 @@ struct ctl_table random_table[] = {
 		.mode		= 0444,
 		.proc_handler	= lrng_proc_do_uuid,
 	},
+	{
+		.procname	= "irq_entropy_avail",
+		.data		= &lrng_stats.irq_entropy_bits,
+		.maxlen		= sizeof(int),
+		.mode		= 0444,
+		.proc_handler	= lrng_proc_do_stats_entropy,
+	},
+	{
+		.procname	= "aux_entropy_avail",
+		.data		= &lrng_stats.aux_entropy_bits,
+		.maxlen		= sizeof(int),
+		.mode		= 0444,
+		.proc_handler	= lrng_proc_do_stats_entropy,
+	},
+	{
+		.procname	= "arch_entropy_avail",
+		.data		= &lrng_stats.arch_entropy_bits,
+		.maxlen		= sizeof(int),
+		.mode		= 0444,
+		.proc_handler	= lrng_proc_do_stats_entropy,
+	},
+	{
+		.procname	= "jent_entropy_avail",
+		.data		= &lrng_stats.jent_entropy_bits,
+		.maxlen		= sizeof(int),
+		.mode		= 0444,
+		.proc_handler	= lrng_proc_do_stats_entropy,
+	},
 	{
 		.procname       = "urandom_min_reseed_secs",
 		.data           = &lrng_drng_reseed_max_time,
@@ -190,9 +275,33 @@ static int lrng_proc_type_show(struct seq_file *m, void *v)
 	return 0;
 }
 
+/*
+ * Cheap statistics export for monitoring: served entirely from the cached
+ * estimates, i.e. a read does not walk the per-CPU collection pools and
+ * does not take the DRNG lock like /proc/lrng_type.
+ */
+static int lrng_proc_entropy_show(struct seq_file *m, void *v)
+{
+	lrng_stats_refresh();
+
+	seq_printf(m,
+		   "IRQ: %d\n"
+		   "Auxiliary: %d\n"
+		   "CPU: %d\n"
+		   "JitterRNG: %d\n",
+		   atomic_read(&lrng_stats.irq_entropy_bits),
+		   atomic_read(&lrng_stats.aux_entropy_bits),
+		   atomic_read(&lrng_stats.arch_entropy_bits),
+		   atomic_read(&lrng_stats.jent_entropy_bits));
+
+	return 0;
+}
+
 static int __init lrng_proc_type_init(void)
 {
 	proc_create_single("lrng_type", 0444, NULL, &lrng_proc_type_show);
+	proc_create_single("lrng_entropy", 0444, NULL,
+			   &lrng_proc_entropy_show);
 	return 0;
 }
 
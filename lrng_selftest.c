@@ -24,6 +24,7 @@
 
 #define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
 
+#include <linux/async.h>
 #include <linux/module.h>
 #include <linux/lrng.h>
 #include <linux/slab.h>
@@ -82,6 +83,52 @@ static inline void lrng_data_process_selftest_u32(u32 data)
 	lrng_data_selftest[lrng_data_idx2array(ptr)] = data & mask;
 }
 
+#ifdef CONFIG_LRNG_COLLECTION_WIDE_SLOTS
+
+static unsigned int lrng_data_process_selftest(void)
+{
+	u32 time;
+
+	/* "poison" the array to verify the operation of the zeroization */
+	lrng_data_selftest[0] = 0xffffffff;
+	lrng_data_selftest[1] = 0xffffffff;
+	lrng_data_selftest[2] = 0xffffffff;
+	lrng_data_selftest_ptr = 0;
+
+	/* With wide slots, each value occupies one full array word. */
+	lrng_data_process_selftest_insert(0);
+	lrng_data_process_selftest_u32(1);
+	lrng_data_process_selftest_insert(2);
+
+	if ((lrng_data_selftest[0] != 0) ||
+	    (lrng_data_selftest[1] != 1) ||
+	    (lrng_data_selftest[2] != 2))
+		goto err;
+
+	/* Reset for next test */
+	lrng_data_selftest[0] = 0;
+	lrng_data_selftest[1] = 0;
+	lrng_data_selftest[2] = 0;
+	lrng_data_selftest_ptr = 0;
+
+	for (time = 0; time < LRNG_DATA_NUM_VALUES; time++)
+		lrng_data_process_selftest_insert(time);
+
+	if ((lrng_data_selftest[0] != 0) ||
+	    (lrng_data_selftest[1] != 1) ||
+	    (lrng_data_selftest[LRNG_DATA_ARRAY_SIZE - 1] !=
+	     LRNG_DATA_NUM_VALUES - 1))
+		goto err;
+
+	return LRNG_SELFTEST_PASSED;
+
+err:
+	pr_err("LRNG data array self-test FAILED\n");
+	return LRNG_SEFLTEST_ERROR_TIME;
+}
+
+#else /* CONFIG_LRNG_COLLECTION_WIDE_SLOTS */
+
 static unsigned int lrng_data_process_selftest(void)
 {
 	u32 time;
@@ -135,6 +182,8 @@ err:
 	return LRNG_SEFLTEST_ERROR_TIME;
 }
 
+#endif /* CONFIG_LRNG_COLLECTION_WIDE_SLOTS */
+
 static unsigned int lrng_gcd_selftest(void)
 {
 	u32 history[10];
@@ -340,13 +389,45 @@ err:
 
 static unsigned int lrng_selftest_status = LRNG_SELFTEST_NOT_EXECUTED;
 
-static int lrng_selftest(void)
+struct lrng_selftest {
+	const char *name;		/* Name reported via sysfs */
+	unsigned int (*selftest)(void);	/* Self test to perform */
+	unsigned int result;		/* Result of last execution */
+	u32 cycles;			/* Duration of last execution */
+};
+
+static struct lrng_selftest lrng_selftests[] = {
+	{ .name = "time_array",	.selftest = lrng_data_process_selftest },
+	{ .name = "chacha20",	.selftest = lrng_chacha20_drng_selftest },
+	{ .name = "hash",	.selftest = lrng_hash_selftest },
+	{ .name = "gcd",	.selftest = lrng_gcd_selftest },
+};
+
+/*
+ * The self tests are executed as parallel asynchronous work to keep them off
+ * the synchronous cold-start path. The counter of outstanding tests starts
+ * at the number of tests so that lrng_selftest_completed() reports false
+ * from the very beginning of boot until the last test finished.
+ */
+static ASYNC_DOMAIN(lrng_selftest_async_domain);
+static atomic_t lrng_selftest_outstanding =
+	ATOMIC_INIT(ARRAY_SIZE(lrng_selftests));
+
+/*
+ * Report whether the power-up self tests completed - the LRNG does not
+ * enter the operational state before.
+ */
+bool lrng_selftest_completed(void)
 {
-	unsigned int ret = lrng_data_process_selftest();
+	return !atomic_read(&lrng_selftest_outstanding);
+}
 
-	ret |= lrng_chacha20_drng_selftest();
-	ret |= lrng_hash_selftest();
-	ret |= lrng_gcd_selftest();
+static void lrng_selftest_finalize(void)
+{
+	unsigned int i, ret = 0;
+
+	for (i = 0; i < ARRAY_SIZE(lrng_selftests); i++)
+		ret |= lrng_selftests[i].result;
 
 	if (ret) {
 		if (IS_ENABLED(CONFIG_LRNG_SELFTEST_PANIC))
@@ -356,10 +437,47 @@ static int lrng_selftest(void)
 	}
 
 	lrng_selftest_status = ret;
+}
 
-	if (lrng_selftest_status)
-		return -EFAULT;
-	return 0;
+static void lrng_selftest_async_one(void *data, async_cookie_t cookie)
+{
+	struct lrng_selftest *test = data;
+	u32 start = random_get_entropy();
+
+	test->result = test->selftest();
+	test->cycles = (u32)(random_get_entropy() - start);
+
+	if (atomic_dec_and_test(&lrng_selftest_outstanding)) {
+		struct entropy_buf eb;
+
+		lrng_selftest_finalize();
+
+		/*
+		 * In case the DRNGs became fully seeded while the self tests
+		 * were still outstanding, the operational transition gated on
+		 * the self test completion must be re-evaluated here: no
+		 * entropy event may ever arrive on an idle system to trigger
+		 * it and a reseed only takes effect on the next generate
+		 * request, leaving blocked readers waiting indefinitely. The
+		 * async worker runs in process context, so drive the state
+		 * machine with an empty seed buffer like the SP800-90B
+		 * startup completion does.
+		 */
+		memset(&eb, 0, sizeof(eb));
+		lrng_init_ops(&eb);
+		lrng_drng_force_reseed();
+	}
+}
+
+static void lrng_selftest_schedule(void)
+{
+	unsigned int i;
+
+	atomic_set(&lrng_selftest_outstanding, ARRAY_SIZE(lrng_selftests));
+	for (i = 0; i < ARRAY_SIZE(lrng_selftests); i++)
+		async_schedule_domain(lrng_selftest_async_one,
+				      &lrng_selftests[i],
+				      &lrng_selftest_async_domain);
 }
 
 #ifdef CONFIG_SYSFS
@@ -367,12 +485,32 @@ static int lrng_selftest(void)
 static int lrng_selftest_sysfs_set(const char *val,
 				   const struct kernel_param *kp)
 {
-	return lrng_selftest();
+	lrng_selftest_schedule();
+	async_synchronize_full_domain(&lrng_selftest_async_domain);
+
+	if (lrng_selftest_status)
+		return -EFAULT;
+	return 0;
+}
+
+/* Report overall status and the duration of each test in cycles. */
+static int lrng_selftest_sysfs_get(char *val, const struct kernel_param *kp)
+{
+	unsigned int i;
+	int len;
+
+	len = sprintf(val, "%u", lrng_selftest_status);
+	for (i = 0; i < ARRAY_SIZE(lrng_selftests); i++)
+		len += sprintf(val + len, " %s:%u", lrng_selftests[i].name,
+			       lrng_selftests[i].cycles);
+	len += sprintf(val + len, "\n");
+
+	return len;
 }
 
 static const struct kernel_param_ops lrng_selftest_sysfs = {
 	.set = lrng_selftest_sysfs_set,
-	.get = param_get_uint,
+	.get = lrng_selftest_sysfs_get,
 };
 module_param_cb(selftest_status, &lrng_selftest_sysfs, &lrng_selftest_status,
 		0644);
@@ -380,7 +518,8 @@ module_param_cb(selftest_status, &lrng_selftest_sysfs, &lrng_selftest_status,
 
 static int __init lrng_selftest_init(void)
 {
-	return lrng_selftest();
+	lrng_selftest_schedule();
+	return 0;
 }
 
 module_init(lrng_selftest_init);
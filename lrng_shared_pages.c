@@ -0,0 +1,205 @@
+// SPDX-License-Identifier: GPL-2.0 OR BSD-2-Clause
+/*
+ * LRNG shared random pages
+ *
+ * mmap interface on /dev/urandom for high-frequency consumers where the
+ * syscall boundary of getrandom(2) dominates: a mapping consists of one
+ * globally shared read-only control page holding a generation counter
+ * followed by per-mapping pages of pre-generated random data.
+ *
+ * User space protocol: record the generation counter when the data pages
+ * are consumed for the first time and compare it on every subsequent
+ * consumption. The kernel bumps the counter whenever a DRNG is reseeded.
+ * A changed counter tells user space that the mapped data predates the
+ * current DRNG state and that it must refill, e.g. by re-mapping or by
+ * falling back to getrandom(2). The counter is conservative: it advances
+ * on the reseed of any DRNG instance, which is a superset of the instance
+ * that generated the data of a particular mapping.
+ *
+ * Note that the data pages are ordinary user space random data buffers:
+ * after fork(2) both processes observe the same bytes and user space
+ * must refill in the child just as with any RNG state held in a process.
+ *
+ * Copyright (C) 2021, Stephan Mueller <smueller@chronox.de>
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
+#include "lrng_internal.h"
+
+/* Upper bound of pre-generated random data per mapping */
+#define LRNG_SHARED_MAX_PAGES	256
+
+/*
+ * Global upper bound of outstanding pre-generated data pages. The interface
+ * is reachable by any process able to open /dev/urandom and the data pages
+ * are unswappable kernel memory - without the cap, creating many mappings
+ * would allow pinning kernel memory only bounded by the mapping count limit.
+ */
+#define LRNG_SHARED_MAX_TOTAL_PAGES	4096
+
+static atomic_t lrng_shared_total_pages = ATOMIC_INIT(0);
+
+/* Layout of the shared control page at file offset 0 */
+struct lrng_shared_ctrl {
+	u32 generation;
+};
+
+/*
+ * The control page is shared by all mappings, allocated on first use and
+ * intentionally never freed as mappings may outlive the file descriptor.
+ */
+static struct lrng_shared_ctrl *lrng_shared_ctrl;
+static DEFINE_MUTEX(lrng_shared_ctrl_lock);
+
+static atomic_t lrng_shared_generation = ATOMIC_INIT(0);
+
+/* Per-mapping state holding the pre-generated random data */
+struct lrng_shared_mapping {
+	refcount_t ref;
+	u32 npages;
+	u8 *data;
+};
+
+void lrng_shared_pages_reseed(void)
+{
+	struct lrng_shared_ctrl *ctrl;
+	u32 generation = (u32)atomic_inc_return(&lrng_shared_generation);
+
+	/*
+	 * Publish the new generation to user space. Racing reseeds of
+	 * different DRNG instances may store their values out of order
+	 * which is harmless: user space only compares for inequality with
+	 * the value recorded at fill time.
+	 */
+	ctrl = READ_ONCE(lrng_shared_ctrl);
+	if (ctrl)
+		WRITE_ONCE(ctrl->generation, generation);
+}
+
+static void lrng_shared_vma_open(struct vm_area_struct *vma)
+{
+	struct lrng_shared_mapping *map = vma->vm_private_data;
+
+	refcount_inc(&map->ref);
+}
+
+static void lrng_shared_vma_close(struct vm_area_struct *vma)
+{
+	struct lrng_shared_mapping *map = vma->vm_private_data;
+
+	if (!refcount_dec_and_test(&map->ref))
+		return;
+
+	if (map->data) {
+		memzero_explicit(map->data, map->npages << PAGE_SHIFT);
+		vfree(map->data);
+		atomic_sub(map->npages, &lrng_shared_total_pages);
+	}
+	kfree(map);
+}
+
+static vm_fault_t lrng_shared_vma_fault(struct vm_fault *vmf)
+{
+	struct lrng_shared_mapping *map = vmf->vma->vm_private_data;
+	struct page *page;
+
+	if (!vmf->pgoff)
+		page = virt_to_page(lrng_shared_ctrl);
+	else if (vmf->pgoff <= map->npages)
+		page = vmalloc_to_page(map->data +
+				       ((vmf->pgoff - 1) << PAGE_SHIFT));
+	else
+		return VM_FAULT_SIGBUS;
+
+	get_page(page);
+	vmf->page = page;
+	return 0;
+}
+
+static const struct vm_operations_struct lrng_shared_vm_ops = {
+	.open = lrng_shared_vma_open,
+	.close = lrng_shared_vma_close,
+	.fault = lrng_shared_vma_fault,
+};
+
+int lrng_shared_pages_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct lrng_shared_mapping *map;
+	unsigned long npages = vma_pages(vma);
+	u32 datalen;
+	int ret;
+
+	/*
+	 * The mapping is read-only: the control page is shared by all
+	 * consumers and the data pages hold DRNG output that must not be
+	 * modifiable after the fact.
+	 */
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	if (vma->vm_pgoff || !npages || npages > LRNG_SHARED_MAX_PAGES + 1)
+		return -EINVAL;
+
+	mutex_lock(&lrng_shared_ctrl_lock);
+	if (!lrng_shared_ctrl) {
+		struct lrng_shared_ctrl *ctrl =
+			(struct lrng_shared_ctrl *)get_zeroed_page(GFP_KERNEL);
+
+		if (ctrl) {
+			ctrl->generation =
+				(u32)atomic_read(&lrng_shared_generation);
+			/* Publish the fully set up page. */
+			smp_store_release(&lrng_shared_ctrl, ctrl);
+		}
+	}
+	mutex_unlock(&lrng_shared_ctrl_lock);
+	if (!lrng_shared_ctrl)
+		return -ENOMEM;
+
+	map = kzalloc(sizeof(*map), GFP_KERNEL);
+	if (!map)
+		return -ENOMEM;
+
+	refcount_set(&map->ref, 1);
+	map->npages = (u32)npages - 1;
+
+	if (map->npages) {
+		if (atomic_add_return(map->npages, &lrng_shared_total_pages) >
+		    LRNG_SHARED_MAX_TOTAL_PAGES) {
+			atomic_sub(map->npages, &lrng_shared_total_pages);
+			kfree(map);
+			return -ENOMEM;
+		}
+
+		datalen = map->npages << PAGE_SHIFT;
+
+		/* Charge the unswappable data pages to the caller's memcg. */
+		map->data = __vmalloc(datalen, GFP_KERNEL | __GFP_ACCOUNT);
+		if (!map->data) {
+			atomic_sub(map->npages, &lrng_shared_total_pages);
+			kfree(map);
+			return -ENOMEM;
+		}
+
+		ret = lrng_drng_get_sleep(map->data, datalen);
+		if (ret < 0 || (u32)ret < datalen) {
+			vfree(map->data);
+			atomic_sub(map->npages, &lrng_shared_total_pages);
+			kfree(map);
+			return (ret < 0) ? ret : -EAGAIN;
+		}
+	}
+
+	vma->vm_private_data = map;
+	vma->vm_ops = &lrng_shared_vm_ops;
+
+	return 0;
+}
@@ -14,14 +14,17 @@
 static int lrng_drng_switch(struct lrng_drng *drng_store,
 			    const struct lrng_crypto_cb *cb, int node)
 {
-	const struct lrng_crypto_cb *old_cb;
-	unsigned long flags = 0, flags2 = 0;
+	const struct lrng_crypto_cb *old_cb = NULL;
+	unsigned long flags = 0;
 	int ret;
 	u8 seed[LRNG_DRNG_SECURITY_STRENGTH_BYTES];
 	void *new_drng = cb->lrng_drng_alloc(LRNG_DRNG_SECURITY_STRENGTH_BYTES);
-	void *old_drng, *new_hash, *old_hash;
+	void *old_drng = NULL;
+	struct lrng_drng_hash *new_state, *old_state;
+	void *new_hash;
 	u32 current_security_strength;
-	bool sl = false, reset_drng = !lrng_get_available();
+	bool sl = false, release_old = false,
+	     reset_drng = !lrng_get_available();
 
 	if (IS_ERR(new_drng)) {
 		pr_warn("could not allocate new DRNG for NUMA node %d (%ld)\n",
@@ -44,6 +47,15 @@ static int lrng_drng_switch(struct lrng_drng *drng_store,
 		return -EINVAL;
 	}
 
+	new_state = kmalloc(sizeof(*new_state), GFP_KERNEL);
+	if (!new_state) {
+		cb->lrng_hash_dealloc(new_hash);
+		cb->lrng_drng_dealloc(new_drng);
+		return -ENOMEM;
+	}
+	new_state->crypto_cb = cb;
+	new_state->hash = new_hash;
+
 	current_security_strength = lrng_security_strength();
 	lrng_drng_lock(drng_store, &flags);
 
@@ -77,7 +89,6 @@ static int lrng_drng_switch(struct lrng_drng *drng_store,
 	}
 
 	mutex_lock(&drng_store->lock);
-	write_lock_irqsave(&drng_store->hash_lock, flags2);
 	/*
 	 * If we switch the DRNG from the initial ChaCha20 DRNG to something
 	 * else, there is a lock transition from spin lock to mutex (see
@@ -91,19 +102,21 @@ static int lrng_drng_switch(struct lrng_drng *drng_store,
 		__acquire(&drng_store->spin_lock);
 	}
 
+	old_state = rcu_dereference_protected(drng_store->hash_state,
+					lockdep_is_held(&drng_store->lock));
+
 	/* Trigger the switch of the aux entropy pool for current node. */
 	if (drng_store == lrng_drng_init_instance()) {
-		ret = lrng_aux_switch_hash(cb, new_hash, drng_store->crypto_cb);
+		ret = lrng_aux_switch_hash(new_state);
 		if (ret)
 			goto err;
 	}
 
 	/* Trigger the switch of the per-CPU entropy pools for current node. */
-	ret = lrng_pcpu_switch_hash(node, cb, new_hash, drng_store->crypto_cb);
+	ret = lrng_pcpu_switch_hash(drng_store, node, new_state);
 	if (ret) {
 		/* Switch the crypto operation back to be consistent */
-		WARN_ON(lrng_aux_switch_hash(drng_store->crypto_cb,
-					     drng_store->hash, cb));
+		WARN_ON(lrng_aux_switch_hash(old_state));
 	} else {
 		if (reset_drng)
 			lrng_drng_reset(drng_store);
@@ -112,9 +125,6 @@ static int lrng_drng_switch(struct lrng_drng *drng_store,
 		old_cb = drng_store->crypto_cb;
 		drng_store->drng = new_drng;
 		drng_store->crypto_cb = cb;
-
-		old_hash = drng_store->hash;
-		drng_store->hash = new_hash;
 		pr_info("Entropy pool read-hash allocated for DRNG for NUMA node %d\n",
 			node);
 
@@ -131,10 +141,7 @@ static int lrng_drng_switch(struct lrng_drng *drng_store,
 						drng_store->fully_seeded));
 
 		/* ChaCha20 serves as atomic instance left untouched. */
-		if (old_drng != &chacha20) {
-			old_cb->lrng_drng_dealloc(old_drng);
-			old_cb->lrng_hash_dealloc(old_hash);
-		}
+		release_old = (old_drng != &chacha20);
 
 		pr_info("DRNG of NUMA node %d switched\n", node);
 	}
@@ -144,9 +151,24 @@ err:
 		spin_unlock_irqrestore(&drng_store->spin_lock, flags);
 	else
 		__release(&drng_store->spin_lock);
-	write_unlock_irqrestore(&drng_store->hash_lock, flags2);
 	mutex_unlock(&drng_store->lock);
 
+	/*
+	 * Note, in the error case the newly allocated DRNG and hash are not
+	 * released as per-CPU entropy pools may already hold a reference to
+	 * the new hash.
+	 */
+	if (release_old) {
+		/*
+		 * Wait until all readers of the retired hash reference
+		 * completed their operation before the reference is released.
+		 */
+		synchronize_rcu();
+		old_cb->lrng_drng_dealloc(old_drng);
+		old_cb->lrng_hash_dealloc(old_state->hash);
+		kfree(old_state);
+	}
+
 	return ret;
 }
 
@@ -164,7 +186,7 @@ static int lrng_drngs_switch(const struct lrng_crypto_cb *cb)
 	if (lrng_drng) {
 		u32 node;
 
-		for_each_online_node(node) {
+		lrng_for_each_drng_instance(node) {
 			if (lrng_drng[node])
 				ret = lrng_drng_switch(lrng_drng[node], cb,
 						       node);
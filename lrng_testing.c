@@ -11,13 +11,17 @@
 #include <linux/bug.h>
 #include <linux/debugfs.h>
 #include <linux/lrng.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/sched.h>
 #include <linux/sched/signal.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
 #include <linux/string.h>
 #include <linux/types.h>
 #include <linux/uaccess.h>
+#include <linux/vmalloc.h>
 #include <linux/workqueue.h>
 #include <asm/errno.h>
 
@@ -244,6 +248,149 @@ static int lrng_testing_extract_user(struct file *file, char __user *buf,
 	return ret;
 }
 
+/****************** High-Volume Raw Entropy Capture Rings ********************/
+
+#ifdef CONFIG_LRNG_RAW_CAPTURE
+
+/* Number of samples held in the capture ring of one CPU */
+#define LRNG_RAW_RING_ENTRIES	(1U << 16)
+
+/*
+ * Layout of one per-CPU capture ring as visible to user space: the first
+ * page holds the free-running write counter, the subsequent pages hold the
+ * sample array. The writer overwrites the oldest samples when user space
+ * does not keep up - the reader detects the lost samples from the counter
+ * advancing by more than the ring size between two drain operations.
+ */
+struct lrng_raw_ring {
+	u32 head;		/* free-running write counter */
+	u8 pad[PAGE_SIZE - sizeof(u32)];
+	u32 data[LRNG_RAW_RING_ENTRIES];
+};
+
+#define LRNG_RAW_RING_SIZE	sizeof(struct lrng_raw_ring)
+
+static DEFINE_PER_CPU(struct lrng_raw_ring *, lrng_raw_capture_ring);
+static bool lrng_raw_capture_enabled;
+static u32 lrng_raw_capture_users;
+static DEFINE_MUTEX(lrng_raw_capture_lock);
+
+/*
+ * Store one sample into the capture ring of the local CPU.
+ *
+ * The ring has exactly one writer - the interrupt handler executing on the
+ * CPU owning the ring - hence the store requires no lock and no atomic
+ * operation: the sample is stored and the new write counter is published
+ * afterwards such that user space never reads an unwritten slot.
+ */
+static bool lrng_raw_capture_store(u32 value)
+{
+	struct lrng_raw_ring *ring;
+	u32 head;
+
+	if (!READ_ONCE(lrng_raw_capture_enabled))
+		return false;
+
+	ring = *this_cpu_ptr(&lrng_raw_capture_ring);
+	if (!ring)
+		return false;
+
+	head = ring->head;
+	ring->data[head & (LRNG_RAW_RING_ENTRIES - 1)] = value;
+	/* Make the sample visible before publishing the new counter. */
+	smp_wmb();
+	WRITE_ONCE(ring->head, head + 1);
+
+	return true;
+}
+
+static int lrng_raw_capture_open(struct inode *inode, struct file *file)
+{
+	int cpu, ret = 0;
+
+	mutex_lock(&lrng_raw_capture_lock);
+
+	/*
+	 * The rings are allocated on first use and intentionally never
+	 * freed as user space mappings may outlive the file descriptor.
+	 */
+	for_each_possible_cpu(cpu) {
+		struct lrng_raw_ring *ring =
+			per_cpu(lrng_raw_capture_ring, cpu);
+
+		if (ring)
+			continue;
+
+		ring = vmalloc_user(LRNG_RAW_RING_SIZE);
+		if (!ring) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		per_cpu(lrng_raw_capture_ring, cpu) = ring;
+	}
+
+	if (++lrng_raw_capture_users == 1)
+		WRITE_ONCE(lrng_raw_capture_enabled, true);
+
+out:
+	mutex_unlock(&lrng_raw_capture_lock);
+	return ret;
+}
+
+static int lrng_raw_capture_release(struct inode *inode, struct file *file)
+{
+	mutex_lock(&lrng_raw_capture_lock);
+	if (!--lrng_raw_capture_users)
+		WRITE_ONCE(lrng_raw_capture_enabled, false);
+	mutex_unlock(&lrng_raw_capture_lock);
+
+	return 0;
+}
+
+/*
+ * Map the capture ring of one CPU: the mmap offset selects the CPU in
+ * units of the ring size, i.e. the ring of CPU n starts at file offset
+ * n * LRNG_RAW_RING_SIZE.
+ */
+static int lrng_raw_capture_mmap(struct file *file,
+				 struct vm_area_struct *vma)
+{
+	unsigned long pages_per_ring = LRNG_RAW_RING_SIZE >> PAGE_SHIFT;
+	unsigned long cpu = vma->vm_pgoff / pages_per_ring;
+	struct lrng_raw_ring *ring;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	if (vma->vm_pgoff % pages_per_ring)
+		return -EINVAL;
+	if ((vma->vm_end - vma->vm_start) > LRNG_RAW_RING_SIZE)
+		return -EINVAL;
+	if (cpu >= nr_cpu_ids || !cpu_possible(cpu))
+		return -EINVAL;
+
+	ring = per_cpu(lrng_raw_capture_ring, cpu);
+	if (!ring)
+		return -EINVAL;
+
+	return remap_vmalloc_range(vma, ring, 0);
+}
+
+static const struct file_operations lrng_raw_capture_fops = {
+	.owner = THIS_MODULE,
+	.open = lrng_raw_capture_open,
+	.release = lrng_raw_capture_release,
+	.mmap = lrng_raw_capture_mmap,
+};
+
+#else /* CONFIG_LRNG_RAW_CAPTURE */
+
+static inline bool lrng_raw_capture_store(u32 value)
+{
+	return false;
+}
+
+#endif /* CONFIG_LRNG_RAW_CAPTURE */
+
 /************** Raw High-Resolution Timer Entropy Data Handling ***************/
 
 #ifdef CONFIG_LRNG_RAW_HIRES_ENTROPY
@@ -261,6 +408,10 @@ static struct lrng_testing lrng_raw_hires = {
 
 bool lrng_raw_hires_entropy_store(u32 value)
 {
+	/* While a capture ring consumer is attached, it takes precedence. */
+	if (lrng_raw_capture_store(value))
+		return true;
+
 	return lrng_testing_store(&lrng_raw_hires, value, &boot_raw_hires_test);
 }
 
@@ -567,6 +718,160 @@ static const struct file_operations lrng_irq_perf_fops = {
 
 #endif /* CONFIG_LRNG_IRQ_PERF */
 
+/**************** Per-Stage Interrupt Performance Histograms *****************/
+
+#ifdef CONFIG_LRNG_IRQ_PERF_STAGES
+
+/* Number of power-of-two buckets - covers the full u32 cycle delta range */
+#define LRNG_PERF_STAGE_BUCKETS	32
+
+/* Size of the report returned by the lrng_irq_perf_stages debugfs file */
+#define LRNG_PERF_STAGE_REPORT_SIZE	4096
+
+/*
+ * Per-CPU cycle histograms for the stages of the interrupt handling path.
+ * The writer is the interrupt handler executing on the CPU owning the
+ * histogram - the increment is a per-CPU operation on a CPU-local cache
+ * line and thus requires neither a lock nor an atomic operation. This
+ * keeps the instrumentation cheap enough to remain enabled on production
+ * systems.
+ */
+static DEFINE_PER_CPU(u64 [lrng_perf_stage_max][LRNG_PERF_STAGE_BUCKETS],
+		      lrng_perf_stage_hist);
+
+static const char * const lrng_perf_stage_names[lrng_perf_stage_max] = {
+	"health_test",
+	"array_insert",
+	"array_compress",
+};
+
+void lrng_perf_stage_time(enum lrng_perf_stage stage, u32 start)
+{
+	u32 delta = random_get_entropy() - start;
+
+	this_cpu_inc(lrng_perf_stage_hist[stage][delta ? fls(delta) - 1 : 0]);
+}
+
+/* Upper bound in cycles of the given histogram bucket */
+static inline u64 lrng_perf_stage_bucket_max(u32 bucket)
+{
+	return (1ULL << (bucket + 1)) - 1;
+}
+
+/* Extract the given percentile from a merged histogram of one stage */
+static u64 lrng_perf_stage_percentile(const u64 *hist, u64 samples,
+				      u32 percent)
+{
+	u64 threshold = div_u64(samples * percent, 100);
+	u64 seen = 0;
+	u32 i;
+
+	for (i = 0; i < LRNG_PERF_STAGE_BUCKETS; i++) {
+		seen += hist[i];
+		if (seen >= threshold)
+			break;
+	}
+
+	return lrng_perf_stage_bucket_max(
+				min_t(u32, i, LRNG_PERF_STAGE_BUCKETS - 1));
+}
+
+static ssize_t lrng_irq_perf_stages_read(struct file *file, char __user *to,
+					 size_t count, loff_t *ppos)
+{
+	u64 (*hist)[LRNG_PERF_STAGE_BUCKETS];
+	char *report;
+	ssize_t len = 0, ret = -ENOMEM;
+	unsigned int stage;
+	int cpu;
+	u32 i;
+
+	/* The report is generated on the first read of the file only. */
+	if (*ppos)
+		return 0;
+
+	hist = kzalloc(lrng_perf_stage_max * LRNG_PERF_STAGE_BUCKETS *
+		       sizeof(u64), GFP_KERNEL);
+	if (!hist)
+		return -ENOMEM;
+
+	report = kmalloc(LRNG_PERF_STAGE_REPORT_SIZE, GFP_KERNEL);
+	if (!report)
+		goto out;
+
+	/*
+	 * Merge the per-CPU histograms - the readout races with concurrent
+	 * interrupt handlers which is harmless for the statistical report.
+	 */
+	for_each_possible_cpu(cpu) {
+		for (stage = 0; stage < lrng_perf_stage_max; stage++) {
+			for (i = 0; i < LRNG_PERF_STAGE_BUCKETS; i++)
+				hist[stage][i] += per_cpu(lrng_perf_stage_hist,
+							  cpu)[stage][i];
+		}
+	}
+
+	for (stage = 0; stage < lrng_perf_stage_max; stage++) {
+		u64 samples = 0;
+
+		for (i = 0; i < LRNG_PERF_STAGE_BUCKETS; i++)
+			samples += hist[stage][i];
+
+		len += scnprintf(report + len,
+				 LRNG_PERF_STAGE_REPORT_SIZE - len,
+				 "%s: %llu samples, p50 <= %llu p90 <= %llu p99 <= %llu cycles\n",
+				 lrng_perf_stage_names[stage], samples,
+				 lrng_perf_stage_percentile(hist[stage],
+							    samples, 50),
+				 lrng_perf_stage_percentile(hist[stage],
+							    samples, 90),
+				 lrng_perf_stage_percentile(hist[stage],
+							    samples, 99));
+
+		len += scnprintf(report + len,
+				 LRNG_PERF_STAGE_REPORT_SIZE - len,
+				 "%s hist:", lrng_perf_stage_names[stage]);
+		for (i = 0; i < LRNG_PERF_STAGE_BUCKETS; i++)
+			len += scnprintf(report + len,
+					 LRNG_PERF_STAGE_REPORT_SIZE - len,
+					 " %llu", hist[stage][i]);
+		len += scnprintf(report + len,
+				 LRNG_PERF_STAGE_REPORT_SIZE - len, "\n");
+	}
+
+	ret = simple_read_from_buffer(to, count, ppos, report, len);
+	kfree(report);
+out:
+	kfree(hist);
+	return ret;
+}
+
+/* A write of arbitrary data resets the histograms */
+static ssize_t lrng_irq_perf_stages_write(struct file *file,
+					  const char __user *buf,
+					  size_t nbytes, loff_t *ppos)
+{
+	int cpu;
+
+	/*
+	 * The reset races with concurrent interrupt handlers and may lose
+	 * single increments which is harmless for the statistical report.
+	 */
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(&lrng_perf_stage_hist, cpu), 0,
+		       sizeof(lrng_perf_stage_hist));
+
+	return nbytes;
+}
+
+static const struct file_operations lrng_irq_perf_stages_fops = {
+	.owner = THIS_MODULE,
+	.read = lrng_irq_perf_stages_read,
+	.write = lrng_irq_perf_stages_write,
+};
+
+#endif /* CONFIG_LRNG_IRQ_PERF_STAGES */
+
 /*********************************** ACVT ************************************/
 
 #ifdef CONFIG_LRNG_ACVT_HASH
@@ -629,6 +934,142 @@ static const struct file_operations lrng_acvt_hash_fops = {
 
 #endif /* CONFIG_LRNG_ACVT_DRNG */
 
+/****************************** Microbenchmark *******************************/
+
+#ifdef CONFIG_LRNG_BENCHMARK
+
+static u32 bench_iterations = 1024;
+module_param(bench_iterations, uint, 0644);
+MODULE_PARM_DESC(bench_iterations, "Number of iterations executed per benchmarked operation");
+
+/* Upper bound of the iteration count to limit the sample memory footprint */
+#define LRNG_BENCH_MAX_ITERATIONS	(1U << 20)
+
+/* Size of the benchmark report returned by the lrng_bench debugfs file */
+#define LRNG_BENCH_REPORT_SIZE		512
+
+/*
+ * Working buffer the benchmarked operations read from or write to. The
+ * buffer is static as its contents are irrelevant for the measurement and
+ * a per-iteration initialization would perturb the measured execution time.
+ */
+static u8 lrng_bench_buf[LRNG_MAX_DIGESTSIZE] __aligned(LRNG_KCAPI_ALIGN);
+
+static void lrng_bench_drng_get(void)
+{
+	lrng_drng_get_sleep(lrng_bench_buf, sizeof(lrng_bench_buf));
+}
+
+#ifdef CONFIG_LRNG_IRQ
+static void lrng_bench_pcpu_pool_hash(void)
+{
+	lrng_pcpu_pool_hash(lrng_bench_buf, lrng_security_strength(), true);
+}
+#endif
+
+static void lrng_bench_pool_insert_aux(void)
+{
+	lrng_pool_insert_aux(lrng_bench_buf, sizeof(lrng_bench_buf), 0);
+}
+
+#ifdef CONFIG_LRNG_HEALTH_TESTS
+/*
+ * The measurement includes the gathering of the time stamp fed into the
+ * health test which matches the sequence of the interrupt handler.
+ */
+static void lrng_bench_health_test(void)
+{
+	lrng_health_test(random_get_entropy());
+}
+#endif
+
+struct lrng_bench_target {
+	const char *name;
+	void (*victim)(void);
+};
+
+static const struct lrng_bench_target lrng_bench_targets[] = {
+	{ "drng_get", lrng_bench_drng_get },
+#ifdef CONFIG_LRNG_IRQ
+	{ "pcpu_pool_hash", lrng_bench_pcpu_pool_hash },
+#endif
+	{ "pool_insert_aux", lrng_bench_pool_insert_aux },
+#ifdef CONFIG_LRNG_HEALTH_TESTS
+	{ "health_test", lrng_bench_health_test },
+#endif
+};
+
+static int lrng_bench_cmp_u32(const void *a, const void *b)
+{
+	u32 x = *(const u32 *)a, y = *(const u32 *)b;
+
+	if (x < y)
+		return -1;
+	if (x > y)
+		return 1;
+	return 0;
+}
+
+static int lrng_bench_run(const struct lrng_bench_target *target,
+			  u32 *samples, u32 iterations, char *buf, size_t len)
+{
+	u64 sum = 0;
+	u32 i;
+
+	for (i = 0; i < iterations; i++) {
+		u32 start = random_get_entropy();
+
+		target->victim();
+		samples[i] = random_get_entropy() - start;
+		sum += samples[i];
+		cond_resched();
+	}
+
+	sort(samples, iterations, sizeof(u32), lrng_bench_cmp_u32, NULL);
+
+	return scnprintf(buf, len,
+			 "%s: min %u avg %llu p99 %u cycles (%u iterations)\n",
+			 target->name, samples[0], div_u64(sum, iterations),
+			 samples[iterations - DIV_ROUND_UP(iterations, 100)],
+			 iterations);
+}
+
+static ssize_t lrng_bench_read(struct file *file, char __user *to,
+			       size_t count, loff_t *ppos)
+{
+	u32 iterations = clamp_t(u32, bench_iterations, 1,
+				 LRNG_BENCH_MAX_ITERATIONS);
+	char report[LRNG_BENCH_REPORT_SIZE];
+	u32 *samples;
+	ssize_t len = 0;
+	unsigned int i;
+
+	/* The benchmark is executed on the first read of the file only. */
+	if (*ppos)
+		return 0;
+
+	samples = kvmalloc_array(iterations, sizeof(u32), GFP_KERNEL);
+	if (!samples)
+		return -ENOMEM;
+
+	for (i = 0; i < ARRAY_SIZE(lrng_bench_targets); i++)
+		len += lrng_bench_run(&lrng_bench_targets[i], samples,
+				      iterations, report + len,
+				      sizeof(report) - len);
+
+	memzero_explicit(lrng_bench_buf, sizeof(lrng_bench_buf));
+	kvfree(samples);
+
+	return simple_read_from_buffer(to, count, ppos, report, len);
+}
+
+static const struct file_operations lrng_bench_fops = {
+	.owner = THIS_MODULE,
+	.read = lrng_bench_read,
+};
+
+#endif /* CONFIG_LRNG_BENCHMARK */
+
 /**************************************************************************
  * Debugfs interface
  **************************************************************************/
@@ -677,11 +1118,25 @@ static int __init lrng_raw_init(void)
 	debugfs_create_file_unsafe("lrng_irq_perf", 0400, lrng_raw_debugfs_root,
 				   NULL, &lrng_irq_perf_fops);
 #endif
+#ifdef CONFIG_LRNG_IRQ_PERF_STAGES
+	debugfs_create_file_unsafe("lrng_irq_perf_stages", 0600,
+				   lrng_raw_debugfs_root, NULL,
+				   &lrng_irq_perf_stages_fops);
+#endif
 #ifdef CONFIG_LRNG_ACVT_HASH
 	debugfs_create_file_unsafe("lrng_acvt_hash", 0600,
 				   lrng_raw_debugfs_root, NULL,
 				   &lrng_acvt_hash_fops);
 #endif
+#ifdef CONFIG_LRNG_RAW_CAPTURE
+	debugfs_create_file_unsafe("lrng_raw_capture", 0400,
+				   lrng_raw_debugfs_root, NULL,
+				   &lrng_raw_capture_fops);
+#endif
+#ifdef CONFIG_LRNG_BENCHMARK
+	debugfs_create_file_unsafe("lrng_bench", 0400, lrng_raw_debugfs_root,
+				   NULL, &lrng_bench_fops);
+#endif
 
 	return 0;
 }
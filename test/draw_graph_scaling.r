@@ -0,0 +1,38 @@
+# Plot data from the speedtest_mt contention benchmark
+#
+# 1. create file with the speedtest_mt output for one buffer size with the
+#    following format:
+#
+# Readers	Writers	Blocksize	MB/s	p50 ns	p99 ns	p999 ns
+# 1	0	4096	1250.000	3100	4900	7800
+# 2	0	4096	2310.000	3300	5600	9100
+# 4	0	4096	4100.000	3700	7900	14000
+# 8	0	4096	6900.000	4400	15000	31000
+#
+# 2. Generate plot: Rscript --vanilla draw_graph_scaling.r contention.data
+#
+
+args <- commandArgs(trailingOnly = TRUE)
+
+if (length(args) != 1) {
+	stop("Invoke with <input file>")
+}
+
+file <- args[1]
+
+data <- read.csv(file=file, header=TRUE, sep="\t")
+
+svg("getrandom_scaling.svg", width=8, height=5, pointsize=10)
+
+par(mar=c(5, 4, 4, 4) + 0.3)
+
+# print throughput over reader threads
+plot(data[,1], data[,4], type="b", col="red", main="getrandom() scaling", pch=19, xlab="Reader threads", ylab="Throughput in MB/s")
+
+# print p99 latency on the second axis
+par(new=TRUE)
+plot(data[,1], data[,6], type="b", col="blue", pch=19, axes=FALSE, xlab="", ylab="")
+axis(side=4, at=pretty(range(data[,6])))
+mtext("p99 latency in ns", side=4, line=3)
+
+legend("topleft", legend=c("Throughput", "p99 latency"), col=c("red", "blue"), lty=1)
@@ -21,6 +21,7 @@
 #
 
 SPEED="./speedtest"
+SPEED_MT="./speedtest_mt"
 
 remove_module()
 {
@@ -99,13 +100,57 @@ ctr_drbg_speed()
 	remove_module lrng_drbg
 }
 
+ctr_drbg_dedicated_speed()
+{
+	remove_module lrng_drbg
+	remove_module lrng_drbg_ctr
+	insert_module lrng_drbg_ctr
+
+	if [ -z "$(lsmod | grep lrng_drbg_ctr)" ]
+	then
+		echo "Dedicated CTR DRBG test disabled"
+		return
+	fi
+
+	measure_speed "Dedicated CTR DRBG AES-256"
+	remove_module lrng_drbg_ctr
+}
+
 chacha20_drng_speed()
 {
 	remove_module lrng_drbg
+	remove_module lrng_drbg_ctr
 
 	measure_speed "ChaCha20 DRNG"
 }
 
+#
+# Measure the getrandom() scalability: sweep over thread counts and buffer
+# sizes with pinned reader threads and report throughput and latency
+# percentiles. The second run adds one RNDADDENTROPY writer thread to
+# exercise the reseed path concurrently with the readers.
+#
+contention_speed()
+{
+	if [ ! -x "$SPEED_MT" ]
+	then
+		echo "Contention test disabled - $SPEED_MT not present"
+		return
+	fi
+
+	threads=""
+	for i in 1 2 4 8 $(nproc)
+	do
+		threads="$threads -t $i"
+	done
+
+	echo "getrandom() contention - read-only"
+	$SPEED_MT $threads -b 16 -b 256 -b 4096
+
+	echo "getrandom() contention - mixed read/write"
+	$SPEED_MT $threads -b 16 -b 256 -b 4096 -w 1
+}
+
 if [ $(id -u) -ne 0 ]
 then
 	echo "Test must be run as root"
@@ -121,12 +166,15 @@ then
 
 	# Enable/disable as needed
 	ctr_drbg_speed
+	ctr_drbg_dedicated_speed
 	hash_drbg_speed
 	hmac_drbg_speed
 	chacha20_drng_speed
+	contention_speed
 else
 	echo "Upstream /dev/urandom Speed test on $CPU"
 	echo -e "DRNG name\tBlocksize\tSpeed"
 
 	chacha20_drng_speed
+	contention_speed
 fi
@@ -0,0 +1,379 @@
+/*
+ * Copyright (C) 2021, Stephan Mueller <smueller@chronox.de>
+ *
+ * License: see LICENSE file in root directory
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, ALL OF
+ * WHICH ARE HEREBY DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+ * USE OF THIS SOFTWARE, EVEN IF NOT ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/*
+ * Multi-threaded getrandom() contention benchmark
+ *
+ * Each reader thread is pinned to one CPU and measures the latency of every
+ * getrandom() call in a per-thread log-scale histogram. Optional writer
+ * threads inject data via the RNDADDENTROPY ioctl to exercise the reseed
+ * path concurrently with the readers. The tool sweeps over thread counts and
+ * buffer sizes and reports throughput and the p50/p99/p999 latencies, which
+ * exposes the DRNG lock contention that the single-threaded speedtest
+ * cannot show.
+ *
+ * Compile:
+ * gcc -Wall -pedantic -Wextra -O2 -o speedtest_mt speedtest_mt.c -lpthread
+ */
+
+#define _GNU_SOURCE
+#include <sys/random.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <linux/random.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAXLEN		16
+#define WRITE_CHUNK	64
+
+/*
+ * Log-scale latency histogram: 40 power-of-two groups with 32 linear
+ * sub-buckets each cover the nanosecond range with a constant relative
+ * error of ~3% which is sufficient for percentile reporting.
+ */
+#define HIST_GROUPS	40
+#define HIST_SUBBUCKETS	32
+#define HIST_BUCKETS	(HIST_GROUPS * HIST_SUBBUCKETS)
+
+struct opts {
+	uint64_t exectime;
+	size_t buflen;
+	unsigned int threads;
+	unsigned int writers;
+};
+
+struct thread_ctx {
+	pthread_t thread;
+	struct opts *opts;
+	unsigned int cpu;
+	int ret;
+	uint64_t bytes;
+	uint64_t samples;
+	uint64_t hist[HIST_BUCKETS];
+};
+
+static volatile int stop = 0;
+
+static inline uint64_t ts2u64(struct timespec *ts)
+{
+	return (uint64_t)((uint64_t)ts->tv_sec * 1000000000 +
+			  (uint64_t)ts->tv_nsec);
+}
+
+static inline uint64_t get_nstime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts2u64(&ts);
+}
+
+static inline unsigned int hist_bucket(uint64_t ns)
+{
+	unsigned int group, sub;
+
+	if (ns < HIST_SUBBUCKETS)
+		return (unsigned int)ns;
+
+	group = 63 - (unsigned int)__builtin_clzll(ns);
+	sub = (unsigned int)(ns >> (group - 5)) & (HIST_SUBBUCKETS - 1);
+	group -= 4;
+	if (group >= HIST_GROUPS)
+		group = HIST_GROUPS - 1;
+
+	return group * HIST_SUBBUCKETS + sub;
+}
+
+/* Upper boundary in nanoseconds of the given histogram bucket */
+static inline uint64_t hist_bucket_val(unsigned int bucket)
+{
+	unsigned int group = bucket / HIST_SUBBUCKETS;
+	unsigned int sub = bucket % HIST_SUBBUCKETS;
+
+	if (!group)
+		return sub;
+
+	return ((uint64_t)(HIST_SUBBUCKETS + sub)) << (group - 1);
+}
+
+static void hist_insert(struct thread_ctx *ctx, uint64_t ns)
+{
+	ctx->hist[hist_bucket(ns)]++;
+	ctx->samples++;
+}
+
+/* Extract the given percentile from the merged histogram */
+static uint64_t hist_percentile(const uint64_t *hist, uint64_t samples,
+				double percentile)
+{
+	uint64_t threshold = (uint64_t)((double)samples * percentile);
+	uint64_t seen = 0;
+	unsigned int i;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += hist[i];
+		if (seen >= threshold)
+			return hist_bucket_val(i);
+	}
+
+	return hist_bucket_val(HIST_BUCKETS - 1);
+}
+
+static void pin_to_cpu(unsigned int cpu)
+{
+	cpu_set_t cpuset;
+
+	CPU_ZERO(&cpuset);
+	CPU_SET(cpu, &cpuset);
+	pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+}
+
+static void *reader_thread(void *arg)
+{
+	struct thread_ctx *ctx = arg;
+	uint8_t *buffer = malloc(ctx->opts->buflen);
+	ssize_t ret;
+
+	if (!buffer) {
+		ctx->ret = -ENOMEM;
+		return NULL;
+	}
+
+	pin_to_cpu(ctx->cpu);
+
+	while (!stop) {
+		uint64_t start = get_nstime(), end;
+
+		ret = getrandom(buffer, ctx->opts->buflen, 0);
+		end = get_nstime();
+		if (ret < 0) {
+			ctx->ret = -errno;
+			break;
+		}
+
+		hist_insert(ctx, end - start);
+		ctx->bytes += (uint64_t)ret;
+	}
+
+	free(buffer);
+	return NULL;
+}
+
+/*
+ * Writer thread for the mixed read/write mode: inject data without entropy
+ * credit via RNDADDENTROPY which additionally forces a DRNG reseed and thus
+ * exercises the reseed path concurrently with the readers.
+ */
+static void *writer_thread(void *arg)
+{
+	struct thread_ctx *ctx = arg;
+	uint8_t rawbuf[sizeof(struct rand_pool_info) + WRITE_CHUNK];
+	struct rand_pool_info *entropy = (struct rand_pool_info *)rawbuf;
+	int fd = open("/dev/random", O_WRONLY);
+
+	if (fd < 0) {
+		ctx->ret = -errno;
+		return NULL;
+	}
+
+	pin_to_cpu(ctx->cpu);
+
+	entropy->entropy_count = 0;
+	entropy->buf_size = WRITE_CHUNK;
+	memset(entropy->buf, 0xa5, WRITE_CHUNK);
+
+	while (!stop) {
+		if (ioctl(fd, RNDADDENTROPY, entropy) < 0) {
+			ctx->ret = -errno;
+			break;
+		}
+		ctx->bytes += WRITE_CHUNK;
+	}
+
+	close(fd);
+	return NULL;
+}
+
+static int speedtest_mt(struct opts *opts)
+{
+	struct thread_ctx *ctxs;
+	uint64_t hist[HIST_BUCKETS] = { 0 };
+	uint64_t bytes = 0, samples = 0, start, duration;
+	unsigned int i, ncpus = (unsigned int)sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned int nthreads = opts->threads + opts->writers;
+	int ret = 0;
+
+	ctxs = calloc(nthreads, sizeof(*ctxs));
+	if (!ctxs)
+		return -ENOMEM;
+
+	stop = 0;
+	start = get_nstime();
+
+	for (i = 0; i < nthreads; i++) {
+		ctxs[i].opts = opts;
+		ctxs[i].cpu = i % ncpus;
+		ret = pthread_create(&ctxs[i].thread, NULL,
+				     (i < opts->threads) ? reader_thread :
+							   writer_thread,
+				     &ctxs[i]);
+		if (ret) {
+			stop = 1;
+			nthreads = i;
+			ret = -ret;
+			break;
+		}
+	}
+
+	sleep((unsigned int)opts->exectime);
+	stop = 1;
+
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(ctxs[i].thread, NULL);
+		if (ctxs[i].ret && !ret)
+			ret = ctxs[i].ret;
+	}
+
+	duration = get_nstime() - start;
+
+	/* Merge the per-thread histograms of the readers */
+	for (i = 0; i < opts->threads && i < nthreads; i++) {
+		unsigned int j;
+
+		bytes += ctxs[i].bytes;
+		samples += ctxs[i].samples;
+		for (j = 0; j < HIST_BUCKETS; j++)
+			hist[j] += ctxs[i].hist[j];
+	}
+
+	if (!ret && samples) {
+		printf("%u\t%u\t%zu\t%.3f\t%lu\t%lu\t%lu\n",
+		       opts->threads, opts->writers, opts->buflen,
+		       (double)bytes * 1000000000 /
+		       ((double)duration * 1000000),
+		       hist_percentile(hist, samples, 0.50),
+		       hist_percentile(hist, samples, 0.99),
+		       hist_percentile(hist, samples, 0.999));
+	}
+
+	free(ctxs);
+	return ret;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"speedtest_mt [-e <seconds>] [-t <threads>]... [-b <buflen>]... [-w <writers>]\n"
+		"\t-e\truntime per measurement (default 2 seconds)\n"
+		"\t-t\treader thread count - repeat for a sweep (default 1)\n"
+		"\t-b\tbuffer size in bytes - repeat for a sweep (default 16)\n"
+		"\t-w\twriter threads injecting via RNDADDENTROPY (default 0)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct opts opts;
+	size_t buflens[MAXLEN];
+	unsigned int threads[MAXLEN];
+	unsigned int i, j, lens = 0, tcnt = 0;
+	int c = 0;
+
+	opts.exectime = 2;
+	opts.writers = 0;
+
+	while (1) {
+		int opt_index = 0;
+		static struct option options[] =
+		{
+			{"exectime", 1, 0, 'e'},
+			{"buflen", 1, 0, 'b'},
+			{"threads", 1, 0, 't'},
+			{"writers", 1, 0, 'w'},
+			{0, 0, 0, 0}
+		};
+		c = getopt_long(argc, argv, "e:b:t:w:", options, &opt_index);
+		if (-1 == c)
+			break;
+		switch (c) {
+		case 'e':
+			opts.exectime = strtoul(optarg, NULL, 10);
+			if (opts.exectime == ULONG_MAX)
+				return -EINVAL;
+			break;
+		case 'b':
+			if (lens >= MAXLEN)
+				return -EINVAL;
+			buflens[lens] = strtoul(optarg, NULL, 10);
+			lens++;
+			break;
+		case 't':
+			if (tcnt >= MAXLEN)
+				return -EINVAL;
+			threads[tcnt] = (unsigned int)strtoul(optarg, NULL, 10);
+			if (!threads[tcnt])
+				return -EINVAL;
+			tcnt++;
+			break;
+		case 'w':
+			opts.writers = (unsigned int)strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage();
+			return -EINVAL;
+		}
+	}
+
+	if (!lens) {
+		buflens[0] = 16;
+		lens = 1;
+	}
+	if (!tcnt) {
+		threads[0] = 1;
+		tcnt = 1;
+	}
+
+	printf("Readers\tWriters\tBlocksize\tMB/s\tp50 ns\tp99 ns\tp999 ns\n");
+
+	for (i = 0; i < tcnt; i++) {
+		for (j = 0; j < lens; j++) {
+			int ret;
+
+			opts.threads = threads[i];
+			opts.buflen = buflens[j];
+			ret = speedtest_mt(&opts);
+			if (ret)
+				return ret;
+		}
+	}
+
+	return 0;
+}